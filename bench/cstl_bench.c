@@ -0,0 +1,649 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_bench.c
+*
+* DESCRIPTION:     Microbenchmarks for the cstl containers
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+/* the typed containers go through the same counters as count_allocator */
+#define CSTL_REALLOC(ptr, old, size)    _count_realloc(NULL, ptr, old, size)
+#define CSTL_FREE(ptr, size)            _count_free(NULL, ptr, size)
+#include "cstl.h"
+#include "cstl_spsc.h"
+#include "cstl_mpmc.h"
+#include "cstl_bqueue.h"
+#include "cstl_deque.h"
+#include "cstl_hashmap.h"
+#include "cstl_alloc.h"
+//===========================
+// Defines
+//===========================
+#define BENCH_GROWTH            10000000
+#define BENCH_SPARSE            1000000
+#define BENCH_FRONT_BACK        100000
+#define BENCH_QUEUE             10000000
+#define BENCH_QUEUE_DEPTH       1000
+#define BENCH_HANDOFF           2000000
+#define BENCH_HASHMAP           1000000
+/* a counting allocator's ctx is the allocator it counts for, NULL is malloc */
+#define counted(ctx)            ((const cstl_allocator *)(ctx))
+
+//===========================
+// Typedefs
+//===========================
+typedef struct {
+    const char *bench;
+    const char *impl;
+    size_t ops;
+    uint64_t ns;
+    size_t allocs;
+    size_t reallocs;
+    size_t bytes;
+    size_t peak;
+} result;
+
+typedef struct {
+    const char *name;
+    void (*run)(size_t scale);
+} benchmark;
+
+//===========================
+// Locals
+//===========================
+static struct {
+    size_t allocs;
+    size_t reallocs;
+    size_t bytes;
+    size_t live;
+    size_t peak;
+} counter;
+
+static volatile uintptr_t sink;
+
+static void *_count_alloc(void *ctx, size_t size);
+static void *_count_realloc(void *ctx, void *ptr, size_t old, size_t size);
+static void _count_free(void *ctx, void *ptr, size_t size);
+
+static const cstl_allocator count_allocator = { _count_alloc, _count_realloc, _count_free, NULL };
+static const cstl_allocator count_huge_allocator = { _count_alloc, _count_realloc, _count_free, (void *)&cstl_huge_allocator };
+
+CSTL_VECTOR_DEFINE(bench_vec, void *)
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+
+//=============================================================================
+static void *
+_count_alloc(
+    void *ctx,
+    size_t size
+)
+//=============================================================================
+{
+    counter.allocs++;
+    counter.bytes += size;
+    counter.live += size;
+    if (counter.live > counter.peak)
+        counter.peak = counter.live;
+
+    return ctx ? counted(ctx)->alloc(counted(ctx)->ctx, size) : malloc(size);
+}
+
+//=============================================================================
+static void *
+_count_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old,
+    size_t size
+)
+//=============================================================================
+{
+    counter.reallocs++;
+    counter.bytes += size;
+    counter.live += size - old;
+    if (counter.live > counter.peak)
+        counter.peak = counter.live;
+
+    return ctx ? counted(ctx)->realloc(counted(ctx)->ctx, ptr, old, size) : realloc(ptr, size);
+}
+
+//=============================================================================
+static void
+_count_free(
+    void *ctx,
+    void *ptr,
+    size_t size
+)
+//=============================================================================
+{
+    counter.live -= size;
+    if (ctx)
+        counted(ctx)->free(counted(ctx)->ctx, ptr, size);
+    else
+        free(ptr);
+}
+
+//=============================================================================
+static uint64_t
+now(
+    void
+)
+//=============================================================================
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//=============================================================================
+static void
+start(
+    result *r,
+    const char *bench,
+    const char *impl,
+    size_t ops
+)
+//=============================================================================
+{
+    memset(&counter, 0, sizeof(counter));
+    memset(r, 0, sizeof(*r));
+    r->bench = bench;
+    r->impl = impl;
+    r->ops = ops;
+    r->ns = now();
+}
+
+/* one JSON object per line, so runs can be diffed and tracked between releases */
+//=============================================================================
+static void
+stop(
+    result *r
+)
+//=============================================================================
+{
+    r->ns = now() - r->ns;
+    r->allocs = counter.allocs;
+    r->reallocs = counter.reallocs;
+    r->bytes = counter.bytes;
+    r->peak = counter.peak;
+
+    printf("{\"bench\":\"%s\",\"impl\":\"%s\",\"ops\":%zu,\"ns_per_op\":%.2f,\"allocs\":%zu,\"reallocs\":%zu,\"bytes_allocated\":%zu,\"peak_bytes\":%zu}\n",
+            r->bench, r->impl, r->ops, r->ops ? (double)r->ns / r->ops : 0.0, r->allocs, r->reallocs, r->bytes, r->peak);
+    fflush(stdout);
+}
+
+/* push_back from empty to n elements, growth goes through realloc every time */
+//=============================================================================
+static void
+bench_growth(
+    size_t scale
+)
+//=============================================================================
+{
+    size_t n = BENCH_GROWTH / scale;
+    size_t i, cap = 0;
+    void **arr = NULL;
+    result r;
+    vector v;
+    bench_vec tv;
+
+    start(&r, "push_back_growth", "vector", n);
+    vector_constructor_alloc(&v, sizeof(void *), &count_allocator);
+    for (i = 0; i < n; i++)
+        vop.push_back(&v, (void *)i);
+    stop(&r);
+    vector_destructor(&v);
+
+    start(&r, "push_back_growth", "vector_huge", n);
+    vector_constructor_alloc(&v, sizeof(void *), &count_huge_allocator);
+    for (i = 0; i < n; i++)
+        vop.push_back(&v, (void *)i);
+    stop(&r);
+    vector_destructor(&v);
+
+    start(&r, "push_back_growth", "typed_vector", n);
+    bench_vec_init(&tv);
+    for (i = 0; i < n; i++)
+        bench_vec_push_back(&tv, (void *)i);
+    stop(&r);
+    bench_vec_destroy(&tv);
+
+    start(&r, "push_back_growth", "array", n);
+    for (i = 0; i < n; i++) {
+        if (i == cap) {
+            arr = _count_realloc(NULL, arr, cap * sizeof(void *), (cap ? cap * 2 : 16) * sizeof(void *));
+            cap = cap ? cap * 2 : 16;
+        }
+        arr[i] = (void *)i;
+    }
+    stop(&r);
+    free(arr);
+}
+
+/* iterate a vector where only one slot in keep is still alive */
+//=============================================================================
+static void
+bench_sparse_iter(
+    size_t scale
+)
+//=============================================================================
+{
+    static const size_t keeps[] = { 2, 16, 128 };
+    size_t n = BENCH_SPARSE / scale;
+    size_t i, j, k, round;
+    void **arr;
+    void *pos;
+    char impl[32];
+    result r;
+    vector v;
+
+    vector_constructor(&v, sizeof(void *));
+    arr = (void **)calloc(n, sizeof(void *));
+    for (k = 0; k < sizeof(keeps) / sizeof(keeps[0]); k++) {
+        vop.clear(&v);
+        for (i = 0; i < n; i++) {
+            vop.push_back(&v, (void *)(i + 1));
+            arr[i] = i % keeps[k] ? NULL : (void *)(i + 1);
+        }
+        for (i = 0; i < n; i++) {
+            if (i % keeps[k])
+                vop.erase(&v, i);
+        }
+
+        snprintf(impl, sizeof(impl), "vector_1_in_%zu", keeps[k]);
+        start(&r, "sparse_iteration", impl, n * 10);
+        for (round = 0; round < 10; round++) {
+            vector_for_each_element_safe(pos, i, j, &v, void)
+                sink += (uintptr_t)pos;
+        }
+        stop(&r);
+
+        snprintf(impl, sizeof(impl), "array_1_in_%zu", keeps[k]);
+        start(&r, "sparse_iteration", impl, n * 10);
+        for (round = 0; round < 10; round++) {
+            for (i = 0; i < n; i++) {
+                if (arr[i])
+                    sink += (uintptr_t)arr[i];
+            }
+        }
+        stop(&r);
+    }
+
+    free(arr);
+    vector_destructor(&v);
+}
+
+/* front and back on a vector whose head and tail have been erased */
+//=============================================================================
+static void
+bench_front_back(
+    size_t scale
+)
+//=============================================================================
+{
+    size_t n = BENCH_SPARSE / scale;
+    size_t ops = BENCH_FRONT_BACK / scale;
+    size_t i;
+    result r;
+    vector v;
+
+    vector_constructor(&v, sizeof(void *));
+    for (i = 0; i < n; i++)
+        vop.push_back(&v, (void *)(i + 1));
+    for (i = 0; i < n; i++) {
+        if (i != n / 2)
+            vop.erase(&v, i);
+    }
+
+    start(&r, "front_back_sparse", "vector", ops * 2);
+    for (i = 0; i < ops; i++)
+        sink += (uintptr_t)vop.front(&v) + (uintptr_t)vop.back(&v);
+    stop(&r);
+
+    vector_destructor(&v);
+}
+
+/* push and pop around a constant depth, the ring wraps but never resizes */
+//=============================================================================
+static void
+bench_queue_steady(
+    size_t scale
+)
+//=============================================================================
+{
+    size_t n = BENCH_QUEUE / scale;
+    size_t i, head = 0, tail = 0, cap = 2 * BENCH_QUEUE_DEPTH;
+    void **ring;
+    result r;
+    queue q;
+
+    queue_constructor_alloc(&q, sizeof(void *), &count_allocator);
+    for (i = 0; i < BENCH_QUEUE_DEPTH; i++)
+        qop.push(&q, (void *)i);
+    start(&r, "queue_steady", "queue", n * 2);
+    for (i = 0; i < n; i++) {
+        qop.push(&q, (void *)i);
+        sink += (uintptr_t)qop.front(&q);
+        qop.pop(&q);
+    }
+    stop(&r);
+    queue_destructor(&q);
+
+    ring = (void **)calloc(cap, sizeof(void *));
+    for (i = 0; i < BENCH_QUEUE_DEPTH; i++)
+        ring[tail++] = (void *)i;
+    start(&r, "queue_steady", "ring", n * 2);
+    for (i = 0; i < n; i++) {
+        ring[tail] = (void *)i;
+        tail = tail + 1 == cap ? 0 : tail + 1;
+        sink += (uintptr_t)ring[head];
+        head = head + 1 == cap ? 0 : head + 1;
+    }
+    stop(&r);
+    free(ring);
+}
+
+/* grow a queue while popping now and then, so _push_q resizes with a wrapped ring */
+//=============================================================================
+static void
+bench_queue_wrap(
+    size_t scale
+)
+//=============================================================================
+{
+    size_t n = BENCH_QUEUE / scale;
+    size_t i;
+    result r;
+    queue q;
+    deque d;
+
+    queue_constructor_alloc(&q, sizeof(void *), &count_allocator);
+    start(&r, "queue_wrap_resize", "queue", n + n / 3);
+    for (i = 0; i < n; i++) {
+        qop.push(&q, (void *)i);
+        if (i % 3 == 0) {
+            sink += (uintptr_t)qop.front(&q);
+            qop.pop(&q);
+        }
+    }
+    stop(&r);
+    queue_destructor(&q);
+    /* same pattern on blocks, growth never touches queued elements */
+    deque_constructor_alloc(&d, sizeof(void *), &count_allocator);
+    start(&r, "queue_wrap_resize", "deque", n + n / 3);
+    for (i = 0; i < n; i++) {
+        dqop.push_back(&d, (void *)i);
+        if (i % 3 == 0) {
+            sink += (uintptr_t)dqop.front(&d);
+            dqop.pop_front(&d);
+        }
+    }
+    stop(&r);
+    deque_destructor(&d);
+}
+
+static spsc_queue handoff_sq;
+static mpmc_queue handoff_mq;
+static bqueue handoff_bq;
+static queue handoff_q;
+static pthread_mutex_t handoff_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t handoff_n;
+
+//=============================================================================
+static void *
+_produce_spsc(
+    void *arg
+)
+//=============================================================================
+{
+    size_t i;
+
+    for (i = 1; i <= handoff_n; i++) {
+        while (!sqop.push(&handoff_sq, (void *)i))
+            sched_yield();
+    }
+    return NULL;
+}
+
+//=============================================================================
+static void *
+_produce_mpmc(
+    void *arg
+)
+//=============================================================================
+{
+    size_t i;
+
+    for (i = 1; i <= handoff_n; i++) {
+        while (!mqop.try_push(&handoff_mq, (void *)i))
+            sched_yield();
+    }
+    return NULL;
+}
+
+//=============================================================================
+static void *
+_produce_bqueue(
+    void *arg
+)
+//=============================================================================
+{
+    size_t i;
+
+    for (i = 1; i <= handoff_n; i++)
+        bqop.push(&handoff_bq, (void *)i);
+    return NULL;
+}
+
+//=============================================================================
+static void *
+_produce_locked(
+    void *arg
+)
+//=============================================================================
+{
+    size_t i;
+
+    for (i = 1; i <= handoff_n; i++) {
+        pthread_mutex_lock(&handoff_lock);
+        qop.push(&handoff_q, (void *)i);
+        pthread_mutex_unlock(&handoff_lock);
+    }
+    return NULL;
+}
+
+/* one producer thread hands elements to the calling thread */
+//=============================================================================
+static void
+bench_handoff(
+    size_t scale
+)
+//=============================================================================
+{
+    void *eles[64];
+    void *ele;
+    size_t got, k;
+    pthread_t t;
+    result r;
+
+    handoff_n = BENCH_HANDOFF / scale;
+
+    spsc_queue_constructor(&handoff_sq, sizeof(void *), 4096);
+    start(&r, "handoff", "spsc_queue", handoff_n);
+    pthread_create(&t, NULL, _produce_spsc, NULL);
+    for (got = 0; got < handoff_n;) {
+        ele = sqop.front(&handoff_sq);
+        if (!ele) {
+            sched_yield();
+            continue;
+        }
+        sink += (uintptr_t)ele;
+        sqop.pop(&handoff_sq);
+        got++;
+    }
+    pthread_join(t, NULL);
+    stop(&r);
+    spsc_queue_destructor(&handoff_sq);
+
+    mpmc_queue_constructor(&handoff_mq, sizeof(void *), 4096);
+    start(&r, "handoff", "mpmc_queue", handoff_n);
+    pthread_create(&t, NULL, _produce_mpmc, NULL);
+    for (got = 0; got < handoff_n;) {
+        k = mqop.pop_n(&handoff_mq, eles, 64);
+        if (!k) {
+            sched_yield();
+            continue;
+        }
+        sink += (uintptr_t)eles[0];
+        got += k;
+    }
+    pthread_join(t, NULL);
+    stop(&r);
+    mpmc_queue_destructor(&handoff_mq);
+
+    bqueue_constructor(&handoff_bq, sizeof(void *));
+    start(&r, "handoff", "bqueue", handoff_n);
+    pthread_create(&t, NULL, _produce_bqueue, NULL);
+    for (got = 0; got < handoff_n;)
+        got += bqop.pop_batch_wait(&handoff_bq, eles, 64, -1);
+    pthread_join(t, NULL);
+    stop(&r);
+    bqueue_destructor(&handoff_bq);
+
+    queue_constructor(&handoff_q, sizeof(void *));
+    start(&r, "handoff", "mutex_queue", handoff_n);
+    pthread_create(&t, NULL, _produce_locked, NULL);
+    for (got = 0; got < handoff_n;) {
+        pthread_mutex_lock(&handoff_lock);
+        k = qop.drain(&handoff_q, eles, 64);
+        pthread_mutex_unlock(&handoff_lock);
+        if (!k)
+            sched_yield();
+        got += k;
+    }
+    pthread_join(t, NULL);
+    stop(&r);
+    queue_destructor(&handoff_q);
+}
+
+/* insert n 8 byte keys, then look every key up and as many absent ones */
+//=============================================================================
+static void
+bench_hashmap(
+    size_t scale
+)
+//=============================================================================
+{
+    size_t n = BENCH_HASHMAP / scale;
+    uint64_t i, k;
+    result r;
+    hashmap m;
+
+    hashmap_constructor_alloc(&m, sizeof(uint64_t), &count_allocator);
+    start(&r, "hashmap", "insert", n);
+    for (i = 0; i < n; i++) {
+        k = i * 0x9e3779b97f4a7c15ULL;
+        hop.insert(&m, &k, (void *)(uintptr_t)i);
+    }
+    stop(&r);
+
+    start(&r, "hashmap", "find_hit", n);
+    for (i = 0; i < n; i++) {
+        k = i * 0x9e3779b97f4a7c15ULL;
+        sink += (uintptr_t)*hop.find(&m, &k);
+    }
+    stop(&r);
+
+    start(&r, "hashmap", "find_miss", n);
+    for (i = 0; i < n; i++) {
+        k = i * 0x9e3779b97f4a7c15ULL + 1;
+        sink += (uintptr_t)hop.find(&m, &k);
+    }
+    stop(&r);
+    hashmap_destructor(&m);
+}
+
+static const benchmark benchmarks[] = {
+    { "push_back_growth", bench_growth },
+    { "sparse_iteration", bench_sparse_iter },
+    { "front_back_sparse", bench_front_back },
+    { "queue_steady", bench_queue_steady },
+    { "queue_wrap_resize", bench_queue_wrap },
+    { "handoff", bench_handoff },
+    { "hashmap", bench_hashmap },
+};
+
+/*
+ * usage: cstl_bench [-s scale] [name ...]
+ *  -s scale  divide every workload size by scale, for quick runs
+ *  name      only run the named benchmarks
+ */
+int main(int argc, char *argv[])
+{
+    size_t scale = 1;
+    size_t i;
+    int opt, j;
+    bool run;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's':
+            scale = strtoul(optarg, NULL, 0);
+            if (!scale)
+                scale = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s scale] [name ...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    vector_op_init();
+    queue_op_init();
+    spsc_queue_op_init();
+    mpmc_queue_op_init();
+    bqueue_op_init();
+    deque_op_init();
+    hashmap_op_init();
+
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        run = optind >= argc;
+        for (j = optind; j < argc; j++) {
+            if (!strcmp(argv[j], benchmarks[i].name))
+                run = true;
+        }
+        if (run)
+            benchmarks[i].run(scale);
+    }
+
+    return 0;
+}
+
+/* EOF */
@@ -23,6 +23,13 @@
 // Includes
 //===========================
 #include "cstl.h"
+#include "cstl_mmap.h"
+#if CSTL_DEBUG
+#include <stdio.h>
+#endif
+#if CSTL_STATS
+#include <pthread.h>
+#endif
 //===========================
 // Defines
 //===========================
@@ -34,12 +41,35 @@
 //===========================
 // Locals
 //===========================
+static const capacity_policy default_policy = CAPACITY_POLICY_DEFAULT;
+
+static void *_malloc_alloc(void *ctx, size_t size);
+static void *_malloc_realloc(void *ctx, void *ptr, size_t old, size_t size);
+static void _malloc_free(void *ctx, void *ptr, size_t size);
+
+#if CSTL_STATS
+/*
+ * live containers and their stats records, a record remembers its slot in _slot so the
+ * container can leave in O(1). The records are only freed on unregister.
+ */
+static struct {
+    pthread_mutex_t _lock;
+    size_t _size;
+    size_t _capacity;
+    struct registry_entry_t {
+        int _kind;
+        void *_container;
+        cstl_stats *_stats;
+    } *_entries;
+} registry = { PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL };
+#endif
 
 //===========================
 // Globals
 //===========================
 vector_operation vop;
 queue_operation qop;
+const cstl_allocator cstl_malloc_allocator = { _malloc_alloc, _malloc_realloc, _malloc_free, NULL };
 
 /* Functions */
 static bool _empty_v(vector *this);
@@ -50,8 +80,20 @@ static void *_front_v(vector *this);
 static void *_back_v(vector *this);
 static bool _push_back_v(vector *this, void *ele);
 static void *_pop_back_v(vector *this);
+static size_t _insert_v(vector *this, void *ele);
 static void _erase_v(vector *this, size_t n);
 static void _clear_v(vector *this);
+static bool _reserve_v(vector *this, size_t n);
+static bool _shrink_to_fit_v(vector *this);
+static bool _set_policy_v(vector *this, const capacity_policy *policy);
+static void _compact_v(vector *this);
+static void _set_compaction_v(vector *this, uint32_t ratio, vector_relocate relocate, void *ctx);
+static void _compact_step_v(vector *this, size_t budget);
+static bool _push_back_n_v(vector *this, void *const *eles, size_t n);
+static bool _append_v(vector *this, vector *src);
+static bool _grow_v(vector *this, size_t n);
+static bool _stats_v(vector *this, cstl_stats *st);
+static bool _sync_v(vector *this);
 
 static bool _empty_q(queue *this);
 static bool _resize_q(queue *this, size_t sz);
@@ -60,6 +102,19 @@ static void *_front_q(queue *this);
 static void *_back_q(queue *this);
 static bool _push_q(queue *this, void *ele);
 static void _pop_q(queue *this);
+static bool _reserve_q(queue *this, size_t n);
+static bool _shrink_to_fit_q(queue *this);
+static bool _set_policy_q(queue *this, const capacity_policy *policy);
+static bool _realloc_q(queue *this, size_t capacity);
+static bool _push_n_q(queue *this, void *const *eles, size_t n);
+static size_t _pop_n_q(queue *this, size_t n);
+static size_t _drain_q(queue *this, void **eles, size_t n);
+static void _shrink_q(queue *this);
+static bool _stats_q(queue *this, cstl_stats *st);
+
+static size_t _grow_capacity(const capacity_policy *policy, size_t capacity, size_t need);
+static size_t _shrink_capacity(const capacity_policy *policy, size_t capacity, size_t used);
+static bool _policy_valid(const capacity_policy *policy);
 
 #if CSTL_DEBUG
 static void dump_data(uint8_t *data, int len, int swap);
@@ -82,9 +137,18 @@ vector_op_init(
     vop.back = _back_v;
     vop.push_back = _push_back_v;
     vop.pop_back = _pop_back_v;
-    vop.insert = NULL;
+    vop.insert = _insert_v;
     vop.erase = _erase_v;
     vop.clear = _clear_v;
+    vop.reserve = _reserve_v;
+    vop.shrink_to_fit = _shrink_to_fit_v;
+    vop.set_policy = _set_policy_v;
+    vop.compact = _compact_v;
+    vop.set_compaction = _set_compaction_v;
+    vop.push_back_n = _push_back_n_v;
+    vop.append = _append_v;
+    vop.stats = _stats_v;
+    vop.sync = _sync_v;
 }
 
 //=============================================================================
@@ -101,6 +165,13 @@ queue_op_init(
     qop.back = _back_q;
     qop.push = _push_q;
     qop.pop = _pop_q;
+    qop.reserve = _reserve_q;
+    qop.shrink_to_fit = _shrink_to_fit_q;
+    qop.set_policy = _set_policy_q;
+    qop.push_n = _push_n_q;
+    qop.pop_n = _pop_n_q;
+    qop.drain = _drain_q;
+    qop.stats = _stats_q;
 }
 
 //=============================================================================
@@ -111,15 +182,54 @@ vector_constructor(
 )
 //=============================================================================
 {
-    v->_vector = (struct vector_t *)calloc(1, sizeof(struct vector_t));
-    if (v->_vector)
-        v->_vector->_type_len = tlen;
+    return vector_constructor_alloc(v, tlen, &cstl_malloc_allocator);
+}
 
-    v->_vector->_bitmap = (struct bitmap_t *)calloc(1, sizeof(struct bitmap_t));
-    if (!v->_vector->_bitmap) {
-        free(v->_vector);
-        v->_vector = NULL;
+/* alloc must stay valid until the vector is destructed */
+//=============================================================================
+inline struct vector_t *
+vector_constructor_alloc(
+    vector *v,
+    uint32_t tlen,
+    const cstl_allocator *alloc
+)
+//=============================================================================
+{
+    size_t capacity = 0;
+    size_t bits;
+    uint32_t flags = 0;
+
+#if CSTL_VECTOR_INLINE
+    /* no more than CSTL_VECTOR_INLINE elements, the bitmap space is reserved for that many */
+    capacity = CSTL_VECTOR_INLINE * sizeof(void *) / tlen;
+    if (capacity > CSTL_VECTOR_INLINE)
+        capacity = CSTL_VECTOR_INLINE;
+    if (capacity) {
+        v->_vector = (struct vector_t *)v->_inline;
+        flags = CSTL_INLINE_STORAGE;
     }
+    else
+#endif
+    {
+        v->_vector = (struct vector_t *)alloc->alloc(alloc->ctx, vector_block_size(0, 0));
+        if (!v->_vector)
+            return NULL;
+    }
+
+    memset(v->_vector, 0, sizeof(struct vector_t));
+    v->_vector->_type_len = tlen;
+    v->_vector->_flags = flags;
+    v->_vector->_alloc = alloc;
+    v->_vector->_policy = default_policy;
+    v->_vector->_capacity = capacity;
+
+    bits = ((capacity >> SHIFT) + (capacity & MASK ? 1 : 0)) * sizeof(int);
+    v->_vector->_bitmap = (struct bitmap_t *)((uint8_t *)v->_vector + vector_bitmap_offset(capacity * tlen));
+    v->_vector->_bitmap->_size = bits;
+    memset(v->_vector->_bitmap->_bitmap, 0, bits);
+#if CSTL_STATS
+    cstl_stats_register(CSTL_STATS_VECTOR, v);
+#endif
 
     debug(LOG_DEBUG, "vector constructor: v: %p, _v: %p, size: %ld, capa: %ld", v, v->_vector, v->_vector->_size, v->_vector->_capacity);
     return v->_vector;
@@ -132,10 +242,22 @@ vector_destructor(
 )
 //=============================================================================
 {
-    if (v->_vector)
-        free(v->_vector);
-    if(v->_vector->_bitmap)
-        free(v->_vector->_bitmap);
+    const cstl_allocator *alloc;
+
+    if (!v->_vector)
+        return;
+
+#if CSTL_STATS
+    cstl_stats_unregister(CSTL_STATS_VECTOR, v);
+#endif
+    if (v->_vector->_flags & CSTL_VECTOR_MAPPED) {
+        vector_map_close(v);
+        return;
+    }
+    alloc = v->_vector->_alloc;
+    if (!(v->_vector->_flags & CSTL_INLINE_STORAGE))
+        alloc->free(alloc->ctx, v->_vector, vector_block_size(size2len3(v, vector), v->_vector->_bitmap->_size));
+    v->_vector = NULL;
 }
 
 //=============================================================================
@@ -146,12 +268,47 @@ queue_constructor(
 )
 //=============================================================================
 {
-    q->_queue = (struct queue_t *)calloc(1, sizeof(struct queue_t));
-    if (q->_queue) {
-        q->_queue->_type_len = tlen;
+    return queue_constructor_alloc(q, tlen, &cstl_malloc_allocator);
+}
+
+/* alloc must stay valid until the queue is destructed */
+//=============================================================================
+inline struct queue_t *
+queue_constructor_alloc(
+    queue *q,
+    uint32_t tlen,
+    const cstl_allocator *alloc
+)
+//=============================================================================
+{
+    size_t capacity = 0;
+    uint32_t flags = 0;
+
+#if CSTL_QUEUE_INLINE
+    capacity = CSTL_QUEUE_INLINE * sizeof(void *) / tlen;
+    if (capacity) {
+        q->_queue = (struct queue_t *)q->_inline;
+        flags = CSTL_INLINE_STORAGE;
+    }
+    else
+#endif
+    {
+        q->_queue = (struct queue_t *)alloc->alloc(alloc->ctx, sizeof(struct queue_t));
+        if (!q->_queue)
+            return NULL;
     }
 
-    debug(LOG_DEBUG, "vector constructor: q: %p, _q: %p, size: %ld, capa: %ld", q, q->_queue, q->_queue->_size, q->_queue->_capacity);
+    memset(q->_queue, 0, sizeof(struct queue_t));
+    q->_queue->_type_len = tlen;
+    q->_queue->_flags = flags;
+    q->_queue->_alloc = alloc;
+    q->_queue->_policy = default_policy;
+    q->_queue->_capacity = capacity;
+#if CSTL_STATS
+    cstl_stats_register(CSTL_STATS_QUEUE, q);
+#endif
+
+    debug(LOG_DEBUG, "queue constructor: q: %p, _q: %p, size: %ld, capa: %ld", q, q->_queue, q->_queue->_size, q->_queue->_capacity);
     return q->_queue;
 }
 
@@ -162,8 +319,18 @@ queue_destructor(
 )
 //=============================================================================
 {
-    if (q->_queue)
-        free(q->_queue);
+    const cstl_allocator *alloc;
+
+    if (!q->_queue)
+        return;
+
+#if CSTL_STATS
+    cstl_stats_unregister(CSTL_STATS_QUEUE, q);
+#endif
+    alloc = q->_queue->_alloc;
+    if (!(q->_queue->_flags & CSTL_INLINE_STORAGE))
+        alloc->free(alloc->ctx, q->_queue, size2len3(q, queue) + sizeof(struct queue_t));
+    q->_queue = NULL;
 }
 
 //=============================================================================
@@ -176,6 +343,11 @@ _empty_v(
     return this->_vector->_used ? false : true;
 }
 
+/*
+ * sz bytes of element storage. Elements and bitmap share one block, the bitmap is moved
+ * down before the block shrinks and up after it grew. Inline storage never shrinks, it is
+ * copied into a heap block the first time it has to grow.
+ */
 //=============================================================================
 static bool
 _resize_v(
@@ -184,41 +356,76 @@ _resize_v(
 )
 //=============================================================================
 {
-    bool rc = true;
-    size_t bitsz;
-    void *vptr_bak = this->_vector;
-    void *bptr_bak = this->_vector->_bitmap;
-
-    debug(LOG_DEBUG, "before resize sz: %ld, v: %p, _v: %p, bp: %p", sz, this, this->_vector, this->_vector->_bitmap);
-    this->_vector = realloc(this->_vector, sz + sizeof(struct vector_t));
-    if (this->_vector == NULL) {
-        this->_vector = vptr_bak;
-        rc = false;
-    }
-    else {
-        /* there is no need to memset, just used for debug */
-#if CSTL_DEBUG
-        memset(this->_vector->_vector + this->_vector->_capacity, 0, sz);
-#endif
-        this->_vector->_capacity = len2size(this, sz, vector);
-    }
+    struct vector_t *vec = this->_vector;
+    const cstl_allocator *alloc = vec->_alloc;
+    void *bak;
+    size_t old = size2len3(this, vector);
+    size_t old_bits = vec->_bitmap->_size;
+    size_t elements;
+    size_t bits;
+    size_t keep;
+
+    /* whole elements only, the allocator is told the exact size on the next call */
+    sz = size2len(this, len2size(this, sz, vector), vector);
+    if (vec->_flags & CSTL_VECTOR_MAPPED)
+        return vector_map_resize(this, sz);
 
     /* big or little endian */
-    bitsz = ((sz / this->_vector->_type_len) >> SHIFT) + ((sz / this->_vector->_type_len) & MASK ? 1 : 0);
-    this->_vector->_bitmap = realloc(this->_vector->_bitmap, bitsz * sizeof(int) + sizeof(struct bitmap_t));
-    if (this->_vector->_bitmap == NULL) {
-        this->_vector->_bitmap = bptr_bak;
-        rc = false;
+    elements = sz / vec->_type_len;
+    bits = ((elements >> SHIFT) + (elements & MASK ? 1 : 0)) * sizeof(int);
+    keep = old_bits < bits ? old_bits : bits;
+    debug(LOG_DEBUG, "before resize sz: %lu, v: %p, _v: %p, bp: %p", sz, this, vec, vec->_bitmap);
+
+    if (vec->_flags & CSTL_INLINE_STORAGE) {
+        if (sz <= old)
+            return true;
+        vec = alloc->alloc(alloc->ctx, vector_block_size(sz, bits));
+        if (!vec)
+            return false;
+        memcpy(vec, this->_vector, sizeof(struct vector_t) + old);
+        memcpy((uint8_t *)vec + vector_bitmap_offset(sz), this->_vector->_bitmap, sizeof(struct bitmap_t) + keep);
+        vec->_flags &= ~CSTL_INLINE_STORAGE;
+        this->_vector = vec;
+        stats_add(this, vector, bytes_copied, sizeof(struct vector_t) + old + sizeof(struct bitmap_t) + keep);
     }
     else {
+        if (sz < old)
+            memmove((uint8_t *)vec + vector_bitmap_offset(sz), vec->_bitmap, sizeof(struct bitmap_t) + keep);
+        vec = alloc->realloc(alloc->ctx, vec, vector_block_size(old, old_bits), vector_block_size(sz, bits));
+        if (!vec) {
+            /* the old block is still there, put its bitmap back */
+            vec = this->_vector;
+            if (sz < old)
+                memmove(vec->_bitmap, (uint8_t *)vec + vector_bitmap_offset(sz), sizeof(struct bitmap_t) + keep);
+            return false;
+        }
+        bak = this->_vector;
+        this->_vector = vec;
+        if (vec != bak)
+            stats_add(this, vector, bytes_copied, vector_block_size(old < sz ? old : sz, keep));
+        if (sz > old) {
+            memmove((uint8_t *)vec + vector_bitmap_offset(sz), (uint8_t *)vec + vector_bitmap_offset(old), sizeof(struct bitmap_t) + keep);
+            stats_add(this, vector, bytes_copied, sizeof(struct bitmap_t) + keep);
+        }
+    }
+
+    /* there is no need to memset, just used for debug */
 #if CSTL_DEBUG
-        memset(this->_vector->_bitmap->_bitmap + this->_vector->_bitmap->_size, 0, bitsz * sizeof(int));
+    if (sz > old)
+        memset((uint8_t *)vec->_vector + old, 0, sz - old);
 #endif
-        this->_vector->_bitmap->_size = bitsz * sizeof(int);
-    }
+    vec->_capacity = elements;
+    vec->_bitmap = (struct bitmap_t *)((uint8_t *)vec + vector_bitmap_offset(sz));
+    /* bits past _size must read as free, the scanners rely on that */
+    if (bits > keep)
+        memset((uint8_t *)vec->_bitmap->_bitmap + keep, 0, bits - keep);
+    vec->_bitmap->_size = bits;
+    stats_add(this, vector, resizes, 1);
+    stats_max(this, vector, max_capacity, vec->_capacity);
+    stats_sync_v(this);
 
-    debug(LOG_DEBUG, "after resize sz: %ld, v: %p, _v: %p, bp: %p, bsz: %ld", sz, this, this->_vector, this->_vector->_bitmap, this->_vector->_bitmap->_size);
-    return rc;
+    debug(LOG_DEBUG, "after resize sz: %lu, v: %p, _v: %p, bp: %p, bsz: %lu", sz, this, vec, vec->_bitmap, vec->_bitmap->_size);
+    return true;
 }
 
 //=============================================================================
@@ -250,15 +457,9 @@ _front_v(
 )
 //=============================================================================
 {
-    size_t n = 0;
-    while(n < this->_vector->_size) {
-        if (_bit_check_v(this, n))
-            return this->_vector->_vector[n];
-
-        n++;
-    }
+    size_t n = _bit_next_v(this, 0);
 
-    return NULL;
+    return n < this->_vector->_size ? this->_vector->_vector[n] : NULL;
 }
 
 //=============================================================================
@@ -269,15 +470,9 @@ _back_v(
 //=============================================================================
 {
     debug(LOG_DEBUG, "vector back v: %p, _v: %p, sz: %ld, vcapa: %ld", this, this->_vector, this->_vector->_size, this->_vector->_capacity);
-    size_t n = this->_vector->_size - 1;
-    while(n >= 0) {
-        if (_bit_check_v(this, n))
-            return this->_vector->_vector[n];
+    size_t n = _bit_prev_v(this, this->_vector->_size);
 
-        n--;
-    }
-
-    return NULL;
+    return n != (size_t)-1 ? this->_vector->_vector[n] : NULL;
 }
 
 //=============================================================================
@@ -290,7 +485,7 @@ _push_back_v(
 {
     debug(LOG_DEBUG, "vector push back v: %p, _v: %p, sz: %ld, used: %ld, vcapa: %ld", this, this->_vector, this->_vector->_size, this->_vector->_used, this->_vector->_capacity);
     if (this->_vector->_size >= this->_vector->_capacity) {
-        if (!_resize_v(this, size2len3(this, vector)  + growth(this, vector))) {
+        if (!_grow_v(this, 1)) {
             return false;
         }
     }
@@ -298,6 +493,11 @@ _push_back_v(
     _bit_set_v(this, this->_vector->_size);
     this->_vector->_vector[this->_vector->_size++] = ele;
     this->_vector->_used++;
+    stats_max(this, vector, max_size, this->_vector->_size);
+    stats_sync_v(this);
+
+    if (this->_vector->_compact._active)
+        _compact_step_v(this, CSTL_COMPACT_STEP);
 
 #if CSTL_DEBUG
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -314,20 +514,66 @@ _pop_back_v(
 )
 //=============================================================================
 {
-    void *ele;
-    if (this->_vector->_size + growth(this, vector) <= this->_vector->_capacity) {
-        if(_resize_v(this, size2len3(this, vector)  - growth(this, vector)))
-            this->_vector->_capacity -= growth(this, vector);
+    void *ele = NULL;
+    size_t capacity;
+
+    /* erased slots at the tail are dropped along with the last live element */
+    while (this->_vector->_size && !ele) {
+        this->_vector->_size--;
+        if (_bit_check_v(this, this->_vector->_size)) {
+            _bit_clear_v(this, this->_vector->_size);
+            ele = this->_vector->_vector[this->_vector->_size];
+            this->_vector->_used--;
+        }
+        this->_vector->_vector[this->_vector->_size] = NULL;
     }
+    stats_sync_v(this);
 
-    _bit_clear_v(this, this->_vector->_size);
-    ele = this->_vector->_vector[this->_vector->_size--];
-    this->_vector->_vector[this->_vector->_size + 1] = NULL;
-    this->_vector->_used--;
+    /* the tail may have been popped into the part a running compaction hasn't reached yet */
+    if (this->_vector->_compact._rd > this->_vector->_size)
+        this->_vector->_compact._rd = this->_vector->_size;
+    if (this->_vector->_compact._wr > this->_vector->_size)
+        this->_vector->_compact._wr = this->_vector->_size;
+
+    capacity = _shrink_capacity(&this->_vector->_policy, this->_vector->_capacity, this->_vector->_size);
+    if (capacity < this->_vector->_capacity)
+        _resize_v(this, size2len(this, capacity, vector));
 
     return ele;
 }
 
+/* Store ele in the lowest free slot, reusing erased ones before growing. Returns the slot
+ * index, or (size_t)-1 if the vector couldn't grow.
+ */
+//=============================================================================
+static size_t
+_insert_v(
+    vector *this,
+    void *ele
+)
+//=============================================================================
+{
+    size_t n;
+
+    /* the gap of a running compaction has to stay free */
+    if (!this->_vector->_compact._active) {
+        n = _bit_next_free_v(this, this->_vector->_hint);
+        this->_vector->_hint = n + 1;
+        if (n < this->_vector->_size) {
+            _bit_set_v(this, n);
+            this->_vector->_vector[n] = ele;
+            this->_vector->_used++;
+            stats_sync_v(this);
+            return n;
+        }
+    }
+
+    if (!_push_back_v(this, ele))
+        return (size_t)-1;
+
+    return this->_vector->_size - 1;
+}
+
 //=============================================================================
 static void
 _erase_v(
@@ -336,8 +582,23 @@ _erase_v(
 )
 //=============================================================================
 {
+    struct compact_t *c = &this->_vector->_compact;
+
+    if (!_bit_check_v(this, n))
+        return;
+
     _bit_clear_v(this, n);
     this->_vector->_used--;
+    stats_sync_v(this);
+    if (n < this->_vector->_hint)
+        this->_vector->_hint = n;
+
+    if (!c->_active && c->_ratio && this->_vector->_size >= CSTL_COMPACT_MIN
+            && this->_vector->_used * 100 < this->_vector->_size * c->_ratio) {
+        c->_active = true;
+        c->_rd = c->_wr = _bit_next_free_v(this, 0);
+    }
+    /* only started here, stepping would move elements under an erasing iteration */
 }
 
 //=============================================================================
@@ -353,6 +614,253 @@ _clear_v(
             this->_vector->_vector[i] = NULL;
     }
     memset(this->_vector->_bitmap->_bitmap, 0, this->_vector->_bitmap->_size);
+    this->_vector->_gen++;
+    this->_vector->_size = 0;
+    this->_vector->_used = 0;
+    stats_sync_v(this);
+    this->_vector->_hint = 0;
+    this->_vector->_compact._active = false;
+}
+
+//=============================================================================
+static bool
+_reserve_v(
+    vector *this,
+    size_t n
+)
+//=============================================================================
+{
+    if (n <= this->_vector->_capacity)
+        return true;
+
+    return _resize_v(this, size2len(this, n, vector));
+}
+
+//=============================================================================
+static bool
+_shrink_to_fit_v(
+    vector *this
+)
+//=============================================================================
+{
+    if (this->_vector->_size == this->_vector->_capacity)
+        return true;
+
+    return _resize_v(this, size2len2(this, vector));
+}
+
+//=============================================================================
+static bool
+_set_policy_v(
+    vector *this,
+    const capacity_policy *policy
+)
+//=============================================================================
+{
+    if (!_policy_valid(policy))
+        return false;
+
+    this->_vector->_policy = *policy;
+    return true;
+}
+
+/* Append n elements with at most one resize, setting their bits a word at a time. */
+//=============================================================================
+static bool
+_push_back_n_v(
+    vector *this,
+    void *const *eles,
+    size_t n
+)
+//=============================================================================
+{
+    if (!n)
+        return true;
+    if (this->_vector->_size + n > this->_vector->_capacity && !_grow_v(this, n))
+        return false;
+
+    memcpy(this->_vector->_vector + this->_vector->_size, eles, size2len(this, n, vector));
+    _bit_set_range_v(this, this->_vector->_size, n);
+    this->_vector->_size += n;
+    this->_vector->_used += n;
+    stats_max(this, vector, max_size, this->_vector->_size);
+    stats_sync_v(this);
+
+    if (this->_vector->_compact._active)
+        _compact_step_v(this, CSTL_COMPACT_STEP);
+    return true;
+}
+
+/* Append the live elements of src, erased slots of src are not carried over. */
+//=============================================================================
+static bool
+_append_v(
+    vector *this,
+    vector *src
+)
+//=============================================================================
+{
+    size_t n = src->_vector->_used;
+    size_t i, k;
+
+    if (!n)
+        return true;
+    if (this->_vector->_size + n > this->_vector->_capacity && !_grow_v(this, n))
+        return false;
+
+    if (src->_vector->_used == src->_vector->_size) {
+        memcpy(this->_vector->_vector + this->_vector->_size, src->_vector->_vector, size2len(this, n, vector));
+    }
+    else {
+        for (i = _bit_next_v(src, 0), k = this->_vector->_size; i < src->_vector->_size; i = _bit_next_v(src, i + 1))
+            this->_vector->_vector[k++] = src->_vector->_vector[i];
+    }
+    _bit_set_range_v(this, this->_vector->_size, n);
+    this->_vector->_size += n;
+    this->_vector->_used += n;
+    stats_max(this, vector, max_size, this->_vector->_size);
+    stats_sync_v(this);
+
+    if (this->_vector->_compact._active)
+        _compact_step_v(this, CSTL_COMPACT_STEP);
+    return true;
+}
+
+/* Make room for n more slots after _size following the capacity policy. */
+//=============================================================================
+static bool
+_grow_v(
+    vector *this,
+    size_t n
+)
+//=============================================================================
+{
+    size_t capacity = _grow_capacity(&this->_vector->_policy, this->_vector->_capacity, this->_vector->_size + n);
+
+    return _resize_v(this, size2len(this, capacity, vector));
+}
+
+/* Copy out the counters, returns false when they are compiled out. */
+//=============================================================================
+static bool
+_stats_v(
+    vector *this,
+    cstl_stats *st
+)
+//=============================================================================
+{
+    memset(st, 0, sizeof(*st));
+#if CSTL_STATS
+    if (this->_vector->_stats)
+        *st = *this->_vector->_stats;
+    st->size = this->_vector->_size;
+    st->used = this->_vector->_used;
+    st->capacity = this->_vector->_capacity;
+    st->tombstones = this->_vector->_size - this->_vector->_used;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Flush dirty pages of a mapped vector to its file, nothing to do for others. */
+//=============================================================================
+static bool
+_sync_v(
+    vector *this
+)
+//=============================================================================
+{
+    if (this->_vector->_flags & CSTL_VECTOR_MAPPED)
+        return vector_map_sync(this);
+
+    return true;
+}
+
+/* Squeeze all live elements to the front of the vector, finishing a running automatic
+ * compaction if there is one.
+ */
+//=============================================================================
+static void
+_compact_v(
+    vector *this
+)
+//=============================================================================
+{
+    struct compact_t *c = &this->_vector->_compact;
+
+    if (!c->_active) {
+        c->_active = true;
+        c->_rd = c->_wr = _bit_next_free_v(this, 0);
+    }
+
+    _compact_step_v(this, (size_t)-1);
+}
+
+/*
+ * ratio is in percent of _size, 0 disables. erase starts a compaction once _used drops below
+ * it, push_back, push_back_n and append then move CSTL_COMPACT_STEP elements each and
+ * vop.compact finishes it. A loop that adds elements while it iterates sees them move.
+ */
+//=============================================================================
+static void
+_set_compaction_v(
+    vector *this,
+    uint32_t ratio,
+    vector_relocate relocate,
+    void *ctx
+)
+//=============================================================================
+{
+    this->_vector->_compact._ratio = ratio;
+    this->_vector->_compact._relocate = relocate;
+    this->_vector->_compact._ctx = ctx;
+}
+
+/* Move at most budget live elements down into the free gap, and shrink the vector once the
+ * whole of it has been swept.
+ */
+//=============================================================================
+static void
+_compact_step_v(
+    vector *this,
+    size_t budget
+)
+//=============================================================================
+{
+    struct compact_t *c = &this->_vector->_compact;
+    size_t capacity;
+
+    while (budget--) {
+        c->_rd = _bit_next_v(this, c->_rd);
+        if (c->_rd >= this->_vector->_size)
+            break;
+
+        if (c->_rd != c->_wr) {
+            this->_vector->_vector[c->_wr] = this->_vector->_vector[c->_rd];
+            this->_vector->_vector[c->_rd] = NULL;
+            _bit_set_v(this, c->_wr);
+            _bit_clear_v(this, c->_rd);
+            if (c->_relocate)
+                c->_relocate(c->_ctx, c->_rd, c->_wr);
+        }
+        c->_rd++;
+        c->_wr++;
+    }
+
+    if (c->_rd < this->_vector->_size)
+        return;
+
+    debug(LOG_DEBUG, "vector compacted v: %p, size: %ld -> %ld, used: %ld", this, this->_vector->_size, c->_wr, this->_vector->_used);
+    c->_active = false;
+    this->_vector->_size = c->_wr;
+    stats_sync_v(this);
+    if (this->_vector->_hint > c->_wr)
+        this->_vector->_hint = c->_wr;
+
+    capacity = _shrink_capacity(&this->_vector->_policy, this->_vector->_capacity, this->_vector->_size);
+    if (capacity < this->_vector->_capacity)
+        _resize_v(this, size2len(this, capacity, vector));
 }
 
 //=============================================================================
@@ -363,7 +871,36 @@ _bit_set_v(
 )
 //=============================================================================
 {
-    this->_vector->_bitmap->_bitmap[n >> SHIFT] |= (1 << (n & MASK));
+    this->_vector->_bitmap->_bitmap[n >> SHIFT] |= (1U << (n & MASK));
+    this->_vector->_gen++;
+}
+
+/* Set cnt bits starting at n, whole words are written at once. */
+//=============================================================================
+inline void
+_bit_set_range_v(
+    vector *this,
+    size_t n,
+    size_t cnt
+)
+//=============================================================================
+{
+    uint32_t *map = this->_vector->_bitmap->_bitmap;
+    size_t end = n + cnt;
+
+    if (!cnt)
+        return;
+
+    this->_vector->_gen++;
+    if ((n >> SHIFT) == ((end - 1) >> SHIFT)) {
+        map[n >> SHIFT] |= (~0U << (n & MASK)) & (~0U >> (MASK - ((end - 1) & MASK)));
+        return;
+    }
+
+    map[n >> SHIFT] |= ~0U << (n & MASK);
+    for (n = (n >> SHIFT) + 1; n < (end - 1) >> SHIFT; n++)
+        map[n] = ~0U;
+    map[n] |= ~0U >> (MASK - ((end - 1) & MASK));
 }
 
 //=============================================================================
@@ -374,7 +911,8 @@ _bit_clear_v(
 )
 //=============================================================================
 {
-    this->_vector->_bitmap->_bitmap[n >> SHIFT] &= (~(1 << (n & MASK)));
+    this->_vector->_bitmap->_bitmap[n >> SHIFT] &= (~(1U << (n & MASK)));
+    this->_vector->_gen++;
 }
 
 //=============================================================================
@@ -385,7 +923,7 @@ _bit_check_v(
 )
 //=============================================================================
 {
-    return this->_vector->_bitmap->_bitmap[n >> SHIFT] & (1 << (n & MASK));
+    return this->_vector->_bitmap->_bitmap[n >> SHIFT] & (1U << (n & MASK));
 }
 
 //=============================================================================
@@ -408,14 +946,32 @@ _resize_q(
 {
     bool rc = true;
     void *qbak = this->_queue;
+    const cstl_allocator *alloc = this->_queue->_alloc;
+    size_t old = size2len3(this, queue);
 
-    this->_queue = realloc(this->_queue, sz + sizeof(struct queue_t));
+    sz = size2len(this, len2size(this, sz, queue), queue);
+    if (this->_queue->_flags & CSTL_INLINE_STORAGE) {
+        /* _realloc_q never shrinks inline storage, this is the first spill to the heap */
+        this->_queue = alloc->alloc(alloc->ctx, sz + sizeof(struct queue_t));
+        if (this->_queue) {
+            memcpy(this->_queue, qbak, old + sizeof(struct queue_t));
+            this->_queue->_flags &= ~CSTL_INLINE_STORAGE;
+        }
+    }
+    else {
+        this->_queue = alloc->realloc(alloc->ctx, this->_queue, old + sizeof(struct queue_t), sz + sizeof(struct queue_t));
+    }
     if (this->_queue == NULL) {
         this->_queue = qbak;
         rc = false;
     }
     else {
         this->_queue->_capacity = len2size(this, sz, queue);
+        stats_add(this, queue, resizes, 1);
+        stats_max(this, queue, max_capacity, this->_queue->_capacity);
+        stats_sync_q(this);
+        if (this->_queue != qbak)
+            stats_add(this, queue, bytes_copied, (old < sz ? old : sz) + sizeof(struct queue_t));
     }
 
     return rc;
@@ -448,7 +1004,7 @@ _back_q(
 )
 //=============================================================================
 {
-    return this->_queue->_queue[this->_queue->_rear - 1];
+    return this->_queue->_queue[this->_queue->_rear ? this->_queue->_rear - 1 : this->_queue->_capacity - 1];
 }
 
 //=============================================================================
@@ -459,44 +1015,23 @@ _push_q(
 )
 //=============================================================================
 {
-    debug(LOG_INFO, "queue push front: %d, rear: %d, size: %ld, capacity: %ld", this->_queue->_front, this->_queue->_rear, this->_queue->_size, this->_queue->_capacity);
-    uint32_t rear;
-    uint32_t capacity;
-    if (this->_queue->_capacity)
-        rear = (this->_queue->_rear + 1) % this->_queue->_capacity;
-    else
-        rear = 0;
-    capacity = this->_queue->_capacity;
-
-    if (rear == this->_queue->_front) {
-        if(!_resize_q(this, size2len3(this, queue) + growth_low_speed(this, queue)))
+    debug(LOG_INFO, "queue push front: %lu, rear: %lu, size: %ld, capacity: %ld", this->_queue->_front, this->_queue->_rear, this->_queue->_size, this->_queue->_capacity);
+    /* one slot always stays free so that front == rear means empty */
+    if (this->_queue->_size + 1 >= this->_queue->_capacity) {
+        if (!_realloc_q(this, _grow_capacity(&this->_queue->_policy, this->_queue->_capacity, this->_queue->_size + 2)))
             return false;
-        else {
-            if (capacity && this->_queue->_rear < this->_queue->_front) {
-                uint32_t size = (this->_queue->_rear - this->_queue->_front + capacity) % capacity;
-                if (this->_queue->_rear > size / 2) {
-                    memmove(this->_queue->_queue + (this->_queue->_front + capacity) * this->_queue->_type_len, this->_queue->_queue + this->_queue->_front * this->_queue->_type_len, (capacity - this->_queue->_front) * this->_queue->_type_len);
-                    this->_queue->_front += size;
-                }
-                else {
-                    memmove(this->_queue->_queue + capacity * this->_queue->_type_len, this->_queue->_queue, (this->_queue->_rear - 1) * this->_queue->_type_len);
-                    this->_queue->_rear += size;
-                }
-            }
-
-            this->_queue->_queue[this->_queue->_rear] = ele;
-            this->_queue->_rear = (this->_queue->_rear + 1) % this->_queue->_capacity;
-            this->_queue->_size++;
-        }
-
     }
-    else {
-        this->_queue->_queue[this->_queue->_rear] = ele;
-        this->_queue->_rear = rear;
-        this->_queue->_size++;
+
+    this->_queue->_queue[this->_queue->_rear] = ele;
+    if (++this->_queue->_rear == this->_queue->_capacity) {
+        this->_queue->_rear = 0;
+        stats_add(this, queue, wraps, 1);
     }
+    this->_queue->_size++;
+    stats_max(this, queue, max_depth, this->_queue->_size);
+    stats_sync_q(this);
 
-    debug(LOG_INFO, "queue push front: %d, rear: %d, size: %ld, capacity: %ld", this->_queue->_front, this->_queue->_rear, this->_queue->_size, this->_queue->_capacity);
+    debug(LOG_INFO, "queue push front: %lu, rear: %lu, size: %ld, capacity: %ld", this->_queue->_front, this->_queue->_rear, this->_queue->_size, this->_queue->_capacity);
     return true;
 }
 
@@ -507,19 +1042,435 @@ _pop_q(
 )
 //=============================================================================
 {
-    if (this->_queue->_front == this->_queue->_rear) {
-        if (_resize_q(this, growth(this, queue))) {
-            this->_queue->_capacity = growth(this, queue);
-            this->_queue->_front = this->_queue->_rear = 0;
-            this->_queue->_size = 0;
+    if (this->_queue->_front == this->_queue->_rear)
+        return;
+
+    if (++this->_queue->_front == this->_queue->_capacity)
+        this->_queue->_front = 0;
+    this->_queue->_size--;
+    stats_sync_q(this);
+    debug(LOG_INFO, "queue pop front: %lu, rear: %lu, size: %ld, capacity: %ld", this->_queue->_front, this->_queue->_rear, this->_queue->_size, this->_queue->_capacity);
+
+    _shrink_q(this);
+}
+
+//=============================================================================
+static bool
+_reserve_q(
+    queue *this,
+    size_t n
+)
+//=============================================================================
+{
+    if (n < this->_queue->_capacity)
+        return true;
+
+    return _realloc_q(this, n + 1);
+}
+
+//=============================================================================
+static bool
+_shrink_to_fit_q(
+    queue *this
+)
+//=============================================================================
+{
+    if (this->_queue->_size + 1 >= this->_queue->_capacity)
+        return true;
+
+    return _realloc_q(this, this->_queue->_size + 1);
+}
+
+//=============================================================================
+static bool
+_set_policy_q(
+    queue *this,
+    const capacity_policy *policy
+)
+//=============================================================================
+{
+    if (!_policy_valid(policy))
+        return false;
+
+    this->_queue->_policy = *policy;
+    return true;
+}
+
+/* Push n elements with at most one resize, copying them in at most two spans. */
+//=============================================================================
+static bool
+_push_n_q(
+    queue *this,
+    void *const *eles,
+    size_t n
+)
+//=============================================================================
+{
+    size_t span;
+
+    if (!n)
+        return true;
+    if (this->_queue->_size + n >= this->_queue->_capacity) {
+        if (!_realloc_q(this, _grow_capacity(&this->_queue->_policy, this->_queue->_capacity, this->_queue->_size + n + 1)))
+            return false;
+    }
+
+    span = this->_queue->_capacity - this->_queue->_rear;
+    if (span > n)
+        span = n;
+    memcpy(this->_queue->_queue + this->_queue->_rear, eles, size2len(this, span, queue));
+    memcpy(this->_queue->_queue, eles + span, size2len(this, n - span, queue));
+    if (span < n || this->_queue->_rear + n == this->_queue->_capacity)
+        stats_add(this, queue, wraps, 1);
+    this->_queue->_rear = (this->_queue->_rear + n) % this->_queue->_capacity;
+    this->_queue->_size += n;
+    stats_max(this, queue, max_depth, this->_queue->_size);
+    stats_sync_q(this);
+
+    return true;
+}
+
+/* Drop up to n elements from the front, returns how many were dropped. */
+//=============================================================================
+static size_t
+_pop_n_q(
+    queue *this,
+    size_t n
+)
+//=============================================================================
+{
+    if (n > this->_queue->_size)
+        n = this->_queue->_size;
+    if (!n)
+        return 0;
+
+    this->_queue->_front = (this->_queue->_front + n) % this->_queue->_capacity;
+    this->_queue->_size -= n;
+    stats_sync_q(this);
+    _shrink_q(this);
+
+    return n;
+}
+
+/* Pop up to n elements into eles in queue order, returns how many were popped. */
+//=============================================================================
+static size_t
+_drain_q(
+    queue *this,
+    void **eles,
+    size_t n
+)
+//=============================================================================
+{
+    size_t span;
+
+    if (n > this->_queue->_size)
+        n = this->_queue->_size;
+    if (!n)
+        return 0;
+
+    span = this->_queue->_capacity - this->_queue->_front;
+    if (span > n)
+        span = n;
+    memcpy(eles, this->_queue->_queue + this->_queue->_front, size2len(this, span, queue));
+    memcpy(eles + span, this->_queue->_queue, size2len(this, n - span, queue));
+
+    return _pop_n_q(this, n);
+}
+
+/* Copy out the counters, returns false when they are compiled out. */
+//=============================================================================
+static bool
+_stats_q(
+    queue *this,
+    cstl_stats *st
+)
+//=============================================================================
+{
+    memset(st, 0, sizeof(*st));
+#if CSTL_STATS
+    if (this->_queue->_stats)
+        *st = *this->_queue->_stats;
+    st->size = this->_queue->_size;
+    st->used = this->_queue->_size;
+    st->capacity = this->_queue->_capacity;
+    st->max_size = st->max_depth;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Give memory back once usage has dropped below the low watermark of the policy. */
+//=============================================================================
+static void
+_shrink_q(
+    queue *this
+)
+//=============================================================================
+{
+    size_t capacity = _shrink_capacity(&this->_queue->_policy, this->_queue->_capacity, this->_queue->_size + 1);
+
+    if (capacity < this->_queue->_capacity)
+        _realloc_q(this, capacity);
+}
+
+/* Change the ring to hold capacity slots and keep the elements in order, capacity must be
+ * larger than _size.
+ */
+//=============================================================================
+static bool
+_realloc_q(
+    queue *this,
+    size_t capacity
+)
+//=============================================================================
+{
+    size_t old = this->_queue->_capacity;
+    size_t front = this->_queue->_front;
+    size_t rear = this->_queue->_rear;
+    size_t size = this->_queue->_size;
+    size_t tail;
+
+    if (capacity <= old && (this->_queue->_flags & CSTL_INLINE_STORAGE))
+        return true;
+
+    if (capacity < old) {
+        /* move the elements below the new capacity before giving the memory back */
+        if (front <= rear) {
+            memmove(this->_queue->_queue, this->_queue->_queue + front, size2len(this, size, queue));
+            stats_add(this, queue, bytes_copied, size2len(this, size, queue));
+            this->_queue->_front = 0;
+            this->_queue->_rear = size;
+        }
+        else {
+            tail = old - front;
+            memmove(this->_queue->_queue + capacity - tail, this->_queue->_queue + front, size2len(this, tail, queue));
+            stats_add(this, queue, bytes_copied, size2len(this, tail, queue));
+            this->_queue->_front = capacity - tail;
         }
+
+        return _resize_q(this, size2len(this, capacity, queue));
     }
-    else {
-        if (this->_queue->_capacity)
-            this->_queue->_front = (this->_queue->_front + 1) % this->_queue->_capacity;
-        this->_queue->_size--;
-        debug(LOG_INFO, "queue pop front: %d, rear: %d, size: %ld, capacity: %ld", this->_queue->_front, this->_queue->_rear, this->_queue->_size, this->_queue->_capacity);
+
+    if (!_resize_q(this, size2len(this, capacity, queue)))
+        return false;
+
+    if (size && rear <= front) {
+        /* wrapped, move whichever part is shorter into the new space */
+        tail = old - front;
+        if (rear <= capacity - old && rear <= tail) {
+            memcpy(this->_queue->_queue + old, this->_queue->_queue, size2len(this, rear, queue));
+            stats_add(this, queue, bytes_copied, size2len(this, rear, queue));
+            this->_queue->_rear = (old + rear) % capacity;
+        }
+        else {
+            memmove(this->_queue->_queue + capacity - tail, this->_queue->_queue + front, size2len(this, tail, queue));
+            stats_add(this, queue, bytes_copied, size2len(this, tail, queue));
+            this->_queue->_front = capacity - tail;
+        }
+    }
+    else if (!size) {
+        this->_queue->_front = this->_queue->_rear = 0;
+    }
+
+    return true;
+}
+
+//=============================================================================
+static size_t
+_grow_capacity(
+    const capacity_policy *policy,
+    size_t capacity,
+    size_t need
+)
+//=============================================================================
+{
+    size_t cap = capacity / 100 * policy->growth + capacity % 100 * policy->growth / 100;
+
+    if (cap <= capacity)
+        cap = capacity + 1;
+    if (cap < policy->min_capacity)
+        cap = policy->min_capacity;
+    if (cap < need)
+        cap = need;
+
+    return cap;
+}
+
+/* Returns the capacity to shrink to, or the current one while usage is above the low watermark. */
+//=============================================================================
+static size_t
+_shrink_capacity(
+    const capacity_policy *policy,
+    size_t capacity,
+    size_t used
+)
+//=============================================================================
+{
+    size_t cap;
+
+    if (!policy->shrink_low || capacity <= policy->min_capacity)
+        return capacity;
+    if (used >= capacity / 100 * policy->shrink_low + capacity % 100 * policy->shrink_low / 100)
+        return capacity;
+
+    cap = used * 100 / policy->shrink_high;
+    if (cap < policy->min_capacity)
+        cap = policy->min_capacity;
+    if (cap < used)
+        cap = used;
+
+    return cap;
+}
+
+//=============================================================================
+static bool
+_policy_valid(
+    const capacity_policy *policy
+)
+//=============================================================================
+{
+    if (policy->growth <= 100)
+        return false;
+    if (policy->shrink_low && (policy->shrink_high <= policy->shrink_low || policy->shrink_high > 100))
+        return false;
+
+    return true;
+}
+
+/* only the stats records are read, the containers may be reallocated by their owners meanwhile */
+//=============================================================================
+inline void
+cstl_stats_foreach(
+    void (*fn)(void *ctx, int kind, void *container, const cstl_stats *st),
+    void *ctx
+)
+//=============================================================================
+{
+#if CSTL_STATS
+    struct registry_entry_t *e;
+    cstl_stats st;
+    size_t i;
+
+    pthread_mutex_lock(&registry._lock);
+    for (i = 0; i < registry._size; i++) {
+        e = &registry._entries[i];
+        st = *e->_stats;
+        st.tombstones = st.size - st.used;
+        if (e->_kind == CSTL_STATS_QUEUE)
+            st.max_size = st.max_depth;
+        fn(ctx, e->_kind, e->_container, &st);
     }
+    pthread_mutex_unlock(&registry._lock);
+#endif
+}
+
+#if CSTL_STATS
+/* Give the container a stats record, it works without one if memory runs out. */
+//=============================================================================
+inline void
+cstl_stats_register(
+    int kind,
+    void *container
+)
+//=============================================================================
+{
+    cstl_stats **slot = kind == CSTL_STATS_VECTOR ? &((vector *)container)->_vector->_stats : &((queue *)container)->_queue->_stats;
+    cstl_stats *st = (cstl_stats *)calloc(1, sizeof(cstl_stats));
+    struct registry_entry_t *entries;
+    size_t capacity;
+
+    *slot = NULL;
+    if (!st)
+        return;
+
+    pthread_mutex_lock(&registry._lock);
+    if (registry._size == registry._capacity) {
+        capacity = registry._capacity ? registry._capacity * 2 : CSTL_MIN_CAPACITY;
+        entries = realloc(registry._entries, capacity * sizeof(*entries));
+        if (!entries) {
+            pthread_mutex_unlock(&registry._lock);
+            free(st);
+            return;
+        }
+        registry._entries = entries;
+        registry._capacity = capacity;
+    }
+
+    st->_slot = registry._size;
+    registry._entries[registry._size]._kind = kind;
+    registry._entries[registry._size]._container = container;
+    registry._entries[registry._size++]._stats = st;
+    *slot = st;
+    pthread_mutex_unlock(&registry._lock);
+
+    if (kind == CSTL_STATS_VECTOR)
+        stats_sync_v((vector *)container);
+    else
+        stats_sync_q((queue *)container);
+}
+
+//=============================================================================
+inline void
+cstl_stats_unregister(
+    int kind,
+    void *container
+)
+//=============================================================================
+{
+    cstl_stats **slot = kind == CSTL_STATS_VECTOR ? &((vector *)container)->_vector->_stats : &((queue *)container)->_queue->_stats;
+    cstl_stats *st = *slot;
+    struct registry_entry_t *last;
+
+    if (!st)
+        return;
+
+    pthread_mutex_lock(&registry._lock);
+    last = &registry._entries[--registry._size];
+    registry._entries[st->_slot] = *last;
+    last->_stats->_slot = st->_slot;
+    pthread_mutex_unlock(&registry._lock);
+
+    free(st);
+    *slot = NULL;
+}
+#endif
+
+//=============================================================================
+static void *
+_malloc_alloc(
+    void *ctx,
+    size_t size
+)
+//=============================================================================
+{
+    return malloc(size);
+}
+
+//=============================================================================
+static void *
+_malloc_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old,
+    size_t size
+)
+//=============================================================================
+{
+    return realloc(ptr, size);
+}
+
+//=============================================================================
+static void
+_malloc_free(
+    void *ctx,
+    void *ptr,
+    size_t size
+)
+//=============================================================================
+{
+    free(ptr);
 }
 
 #if CSTL_DEBUG
@@ -533,7 +1484,8 @@ static void dump_data(uint8_t *data, int len, int swap)
                 data[swap ? (i+4)^3 : i+4], data[swap ? (i+5)^3 : i+5], data[swap ? (i+6)^3 : i+6], data[swap ? (i+7)^3 : i+7],
                 data[swap ? (i+8)^3 : i+8], data[swap ? (i+9)^3 : i+9], data[swap ? (i+10)^3 : i+10], data[swap ? (i+11)^3 : i+11],
                 data[swap ? (i+12)^3 : i+12], data[swap ? (i+13)^3 : i+13], data[swap ? (i+14)^3 : i+14], data[swap ? (i+15)^3 : i+15]);
-        debug(LOG_DEBUG, "%s", line);
+        /* the line lives on the stack, the trace ring only keeps pointers to literals */
+        syslog(LOG_DEBUG, LOG_TAG "%s", line);
         i += 15;
     }
 }
@@ -30,38 +30,170 @@
 #include <stdbool.h>
 #include <string.h>
 #include <syslog.h>
+#include "cstl_trace.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 //===========================
 // Defines
 //===========================
+#ifndef CSTL_DEBUG
 #define CSTL_DEBUG  0
+#endif
+/* per container counters, build with -DCSTL_STATS=0 to compile them out */
+#ifndef CSTL_STATS
+#define CSTL_STATS  1
+#endif
 #ifndef LOG_TAG
 #define LOG_TAG    "[cstl]"
 #endif
 #define SHIFT       5
 #define MASK        0x1f
+#define CSTL_CACHELINE  64
 
-#ifdef CSTL_DEBUG
-#define debug(LOG_LEVEL, fmt, ...) do { syslog(LOG_LEVEL, LOG_TAG fmt, ##__VA_ARGS__); } while (0);
-#else
-#define debug(LOG_LEVEL, fmt, ...)
+/* default capacity policy, growth and watermarks are in percent */
+#define CSTL_GROWTH_FACTOR      200
+#define CSTL_SHRINK_LOW         25
+#define CSTL_SHRINK_HIGH        50
+#define CSTL_MIN_CAPACITY       16
+#define CAPACITY_POLICY_DEFAULT { CSTL_GROWTH_FACTOR, CSTL_SHRINK_LOW, CSTL_SHRINK_HIGH, CSTL_MIN_CAPACITY }
+
+/* live elements moved per push_back, push_back_n or append while an automatic compaction is running */
+#define CSTL_COMPACT_STEP       64
+/* vectors with fewer slots than this are never compacted automatically */
+#define CSTL_COMPACT_MIN        256
+
+/* vector_t._flags, queue_t._flags */
+#define CSTL_VECTOR_MAPPED      0x1     /* lives in a file, see vector_open */
+#define CSTL_INLINE_STORAGE     0x2     /* still in the handle's own buffer */
+
+/*
+ * Elements kept inside the vector/queue handle before the first heap allocation, 0 turns
+ * inline storage off. A handle with inline storage points into itself, it must not be
+ * copied or moved between construction and destruction.
+ */
+#ifndef CSTL_VECTOR_INLINE
+#define CSTL_VECTOR_INLINE      0
+#endif
+#ifndef CSTL_QUEUE_INLINE
+#define CSTL_QUEUE_INLINE       0
+#endif
+/*
+ * What CSTL_VECTOR_DEFINE and CSTL_QUEUE_DEFINE containers allocate with, define both before
+ * including cstl.h to count or redirect it. old and size are the byte sizes of the block, a
+ * NULL block has old 0.
+ */
+#ifndef CSTL_REALLOC
+#define CSTL_REALLOC(ptr, old, size)    realloc(ptr, size)
+#endif
+#ifndef CSTL_FREE
+#define CSTL_FREE(ptr, size)            free(ptr)
 #endif
 
 //===========================
 // Typedefs
 //===========================
+/*
+ * capacity is multiplied by growth / 100 whenever the container is full. it is shrunk only
+ * after usage drops below shrink_low percent of capacity, and then down to a capacity where
+ * usage is shrink_high percent, so a workload oscillating around a boundary doesn't thrash.
+ * shrink_low 0 disables automatic shrinking.
+ */
+typedef struct {
+    uint32_t growth;
+    uint32_t shrink_low;
+    uint32_t shrink_high;
+    size_t min_capacity;
+} capacity_policy;
+
+/*
+ * Where a container gets its memory from. free and realloc are passed the size the block
+ * was allocated with, and a realloc to a smaller size must not fail.
+ */
 typedef struct {
-    struct vector_t {
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t old, size_t size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} cstl_allocator;
+
+/*
+ * Counters read through vop.stats/qop.stats or cstl_stats_foreach. Each registered container
+ * points at its own record, allocated by the registry and never moved, so another thread can
+ * read it while the owner reallocates the container. size, used and capacity are mirrored
+ * into it by the owner whenever they change, tombstones (size - used) is filled in when read.
+ * wraps and max_depth are queue only.
+ */
+typedef struct {
+    size_t size;
+    size_t used;
+    size_t capacity;
+    size_t tombstones;
+    size_t resizes;
+    size_t bytes_copied;
+    size_t max_size;
+    size_t max_capacity;
+    size_t wraps;
+    size_t max_depth;
+    size_t _slot;
+} cstl_stats;
+
+enum {
+    CSTL_STATS_VECTOR,
+    CSTL_STATS_QUEUE,
+};
+
+/* called for every live element compaction moves, so references by index can be patched */
+typedef void (*vector_relocate)(void *ctx, size_t from, size_t to);
+
+/*
+ * Header, elements and bitmap are one block: struct vector_t, _capacity elements, then the
+ * bitmap_t at vector_bitmap_offset. The bitmap moves up or down when the element storage is
+ * resized.
+ */
+struct vector_t {
+    size_t _size;
+    size_t _used;
+    size_t _capacity;
+    uint32_t _type_len;
+    uint32_t _flags;
+    const cstl_allocator *_alloc;
+#if CSTL_STATS
+    /* NULL if the container isn't registered */
+    cstl_stats *_stats;
+#endif
+    /* no free slot below _hint, insert starts looking there */
+    size_t _hint;
+    /* bumped whenever the bitmap changes, a rank_index rebuilds when it sees a new value */
+    size_t _gen;
+    capacity_policy _policy;
+    struct compact_t {
+        vector_relocate _relocate;
+        void *_ctx;
+        uint32_t _ratio;
+        bool _active;
+        /* while active, [0, _wr) is compacted, [_wr, _rd) is free and [_rd, _size) untouched */
+        size_t _rd;
+        size_t _wr;
+    } _compact;
+    struct bitmap_t {
         size_t _size;
-        size_t _used;
-        size_t _capacity;
-        uint32_t _type_len;
-        struct bitmap_t {
-            size_t _size;
-            uint32_t _bitmap[];
-        } *_bitmap;
-        void *_vector[];
-    } *_vector;
+        uint32_t _bitmap[];
+    } *_bitmap;
+    void *_vector[];
+};
+
+#define vector_bitmap_offset(bytes)     (sizeof(struct vector_t) + (((bytes) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1)))
+#define vector_block_size(bytes, bits)  (vector_bitmap_offset(bytes) + sizeof(struct bitmap_t) + (bits))
+
+typedef struct {
+    struct vector_t *_vector;
+#if CSTL_VECTOR_INLINE
+    _Alignas(sizeof(size_t)) uint8_t _inline[vector_block_size(CSTL_VECTOR_INLINE * sizeof(void *), ((CSTL_VECTOR_INLINE + MASK) >> SHIFT) * sizeof(uint32_t))];
+#endif
 } vector;
 
 typedef struct {
@@ -73,20 +205,41 @@ typedef struct {
     void *(*back)(vector *this);
     bool (*push_back)(vector *this, void *ele);
     void *(*pop_back)(vector *this);
-    void (*insert)(vector *this, void *ele);
+    size_t (*insert)(vector *this, void *ele);
     void (*erase)(vector *this, size_t n);
     void (*clear)(vector *this);
+    bool (*reserve)(vector *this, size_t n);
+    bool (*shrink_to_fit)(vector *this);
+    bool (*set_policy)(vector *this, const capacity_policy *policy);
+    void (*compact)(vector *this);
+    void (*set_compaction)(vector *this, uint32_t ratio, vector_relocate relocate, void *ctx);
+    bool (*push_back_n)(vector *this, void *const *eles, size_t n);
+    bool (*append)(vector *this, vector *src);
+    bool (*stats)(vector *this, cstl_stats *st);
+    bool (*sync)(vector *this);
 } vector_operation;
 
+struct queue_t {
+    size_t _size;
+    size_t _capacity;
+    uint32_t _front;
+    uint32_t _rear;
+    uint32_t _type_len;
+    uint32_t _flags;
+    const cstl_allocator *_alloc;
+    capacity_policy _policy;
+#if CSTL_STATS
+    /* NULL if the container isn't registered */
+    cstl_stats *_stats;
+#endif
+    void *_queue[];
+};
+
 typedef struct {
-    struct queue_t {
-        size_t _size;
-        size_t _capacity;
-        uint32_t _front;
-        uint32_t _rear;
-        uint32_t _type_len;
-        void *_queue[];
-    } *_queue;
+    struct queue_t *_queue;
+#if CSTL_QUEUE_INLINE
+    _Alignas(sizeof(size_t)) uint8_t _inline[sizeof(struct queue_t) + CSTL_QUEUE_INLINE * sizeof(void *)];
+#endif
 } queue;
 
 typedef struct {
@@ -97,6 +250,13 @@ typedef struct {
     void *(*back)(queue *this);
     bool (*push)(queue *this, void *ele);
     void (*pop)(queue *this);
+    bool (*reserve)(queue *this, size_t n);
+    bool (*shrink_to_fit)(queue *this);
+    bool (*set_policy)(queue *this, const capacity_policy *policy);
+    bool (*push_n)(queue *this, void *const *eles, size_t n);
+    size_t (*pop_n)(queue *this, size_t n);
+    size_t (*drain)(queue *this, void **eles, size_t n);
+    bool (*stats)(queue *this, cstl_stats *st);
 } queue_operation;
 
 //===========================
@@ -109,30 +269,157 @@ typedef struct {
 
 extern vector_operation vop;
 extern queue_operation qop;
+extern const cstl_allocator cstl_malloc_allocator;
 /* bitmap operation */
 void _bit_set_v(vector *this, size_t n);
+void _bit_set_range_v(vector *this, size_t n, size_t cnt);
 void _bit_clear_v(vector *this, size_t n);
 int32_t _bit_check_v(vector *this, size_t n);
 
 #define growth(dptr, type)                  ((dptr)->_##type->_type_len * 128)
 #define growth_low_speed(dptr, type)                  ((dptr)->_##type->_type_len * 32)
 
+#if CSTL_STATS
+#define stats_add(dptr, type, field, n)     do { if ((dptr)->_##type->_stats) (dptr)->_##type->_stats->field += (n); } while (0)
+#define stats_max(dptr, type, field, n)     do { if ((dptr)->_##type->_stats && (n) > (dptr)->_##type->_stats->field) (dptr)->_##type->_stats->field = (n); } while (0)
+/* mirror _size, _used and _capacity into the stats record, called after they change */
+#define stats_sync_v(v)                     do { if ((v)->_vector->_stats) { (v)->_vector->_stats->size = (v)->_vector->_size; \
+                                                (v)->_vector->_stats->used = (v)->_vector->_used; \
+                                                (v)->_vector->_stats->capacity = (v)->_vector->_capacity; } } while (0)
+#define stats_sync_q(q)                     do { if ((q)->_queue->_stats) { (q)->_queue->_stats->size = (q)->_queue->_size; \
+                                                (q)->_queue->_stats->used = (q)->_queue->_size; \
+                                                (q)->_queue->_stats->capacity = (q)->_queue->_capacity; } } while (0)
+#else
+#define stats_add(dptr, type, field, n)     do { } while (0)
+#define stats_max(dptr, type, field, n)     do { } while (0)
+#define stats_sync_v(v)                     do { } while (0)
+#define stats_sync_q(q)                     do { } while (0)
+#endif
+
 #define len2size(dptr, len, type)           ((len) / (dptr)->_##type->_type_len)
 
 #define size2len(dptr, siz, type)           ((siz) * (dptr)->_##type->_type_len)
 #define size2len2(dptr, type)               ((dptr)->_##type->_size * (dptr)->_##type->_type_len)
 #define size2len3(dptr, type)               ((dptr)->_##type->_capacity * (dptr)->_##type->_type_len)
 
-static inline void *vector_element(vector *vec, size_t *n)
+/* true if the n bitmap words starting at map are all zero, n is 8 for AVX2 and 4 for SSE2 */
+#if defined(__AVX2__)
+#define BITMAP_SKIP 8
+static inline bool _bit_zero_run(const uint32_t *map)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)map);
+    return _mm256_testz_si256(v, v);
+}
+#elif defined(__SSE2__)
+#define BITMAP_SKIP 4
+static inline bool _bit_zero_run(const uint32_t *map)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)map);
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) == 0xffff;
+}
+#endif
+
+/* Returns the first set bit of map at or after n, or size if there is none. */
+static inline size_t _bitmap_next(const uint32_t *map, size_t size, size_t n)
+{
+    size_t words = (size + MASK) >> SHIFT;
+    size_t w = n >> SHIFT;
+    uint32_t bits;
+
+    if (n >= size)
+        return size;
+
+    bits = map[w] & (~0U << (n & MASK));
+    while (!bits) {
+        if (++w >= words)
+            return size;
+#ifdef BITMAP_SKIP
+        while (w + BITMAP_SKIP <= words && _bit_zero_run(map + w))
+            w += BITMAP_SKIP;
+        if (w >= words)
+            return size;
+#endif
+        bits = map[w];
+    }
+
+    n = (w << SHIFT) + __builtin_ctz(bits);
+    return n < size ? n : size;
+}
+
+/* Returns the last set bit of map before n, or (size_t)-1 if there is none. */
+static inline size_t _bitmap_prev(const uint32_t *map, size_t size, size_t n)
+{
+    size_t w;
+    uint32_t bits;
+
+    if (n > size)
+        n = size;
+    if (!n)
+        return (size_t)-1;
+
+    n--;
+    w = n >> SHIFT;
+    bits = map[w] & (~0U >> (MASK - (n & MASK)));
+    while (!bits) {
+        if (!w)
+            return (size_t)-1;
+        w--;
+#ifdef BITMAP_SKIP
+        while (w >= BITMAP_SKIP && _bit_zero_run(map + w - (BITMAP_SKIP - 1)))
+            w -= BITMAP_SKIP;
+#endif
+        bits = map[w];
+    }
+
+    return (w << SHIFT) + MASK - __builtin_clz(bits);
+}
+
+/* Returns the first clear bit of map at or after n, or size if there is none. */
+static inline size_t _bitmap_next_free(const uint32_t *map, size_t size, size_t n)
 {
-    while (*n < vec->_vector->_size) {
-        if (_bit_check_v(vec, (*n))) {
-            debug(LOG_DEBUG, "n %ld, used %ld, size %ld", *n, vec->_vector->_used, vec->_vector->_size);
-            return vec->_vector->_vector[*n];
-        }
-        (*n)++;
+    size_t words = (size + MASK) >> SHIFT;
+    size_t w = n >> SHIFT;
+    uint32_t bits;
+
+    if (n >= size)
+        return size;
+
+    bits = ~map[w] & (~0U << (n & MASK));
+    while (!bits) {
+        if (++w >= words)
+            return size;
+        bits = ~map[w];
     }
+
+    n = (w << SHIFT) + __builtin_ctz(bits);
+    return n < size ? n : size;
+}
+
+/* Returns the first live slot at or after n, or _size if there is none. */
+static inline size_t _bit_next_v(vector *vec, size_t n)
+{
+    return _bitmap_next(vec->_vector->_bitmap->_bitmap, vec->_vector->_size, n);
+}
+
+/* Returns the last live slot before n, or (size_t)-1 if there is none. */
+static inline size_t _bit_prev_v(vector *vec, size_t n)
+{
+    return _bitmap_prev(vec->_vector->_bitmap->_bitmap, vec->_vector->_size, n);
+}
+
+/* Returns the first free slot at or after n, or _size if every slot from n on is live. */
+static inline size_t _bit_next_free_v(vector *vec, size_t n)
+{
+    return _bitmap_next_free(vec->_vector->_bitmap->_bitmap, vec->_vector->_size, n);
+}
+
+static inline void *vector_element(vector *vec, size_t *n)
+{
+    *n = _bit_next_v(vec, *n);
     debug(LOG_DEBUG, "n %ld, used %ld, size %ld", *n, vec->_vector->_used, vec->_vector->_size);
+    if (*n < vec->_vector->_size)
+        return vec->_vector->_vector[*n];
+
     return NULL;
 }
 
@@ -169,6 +456,8 @@ static inline void *vector_next_element(vector *vec, size_t *n)
 
 /**
  * vector_for_each_element_safe	- iterate over vector of given type safe against removal of vector element
+ * Erasing never moves elements. An automatic compaction (vop.set_compaction) is advanced by
+ * push_back, push_back_n, append and vop.compact, don't call those inside the loop.
  * @pos:	the type * to use as a loop cursor.
  * @n:		another unigned int type to use as a loop cursor.
  * @j:		another unigned int type to use as a jump loop cursor.
@@ -181,13 +470,292 @@ static inline void *vector_next_element(vector *vec, size_t *n)
             j++, n++, pos = (typeof(type *))vector_next_element(vec, &n) )
 
 
+/*
+ * Type specialized containers. CSTL_VECTOR_DEFINE(name, T) and CSTL_QUEUE_DEFINE(name, T)
+ * emit a container type called name that stores T by value in one contiguous array, with
+ * static inline name_xxx() functions the compiler can inline, no vop/qop indirection. The
+ * vector keeps the occupancy bitmap, so erase leaves a free slot just like vop.erase, and
+ * the queue is a ring with power of two capacity.
+ *
+ *  CSTL_VECTOR_DEFINE(ivec, int)
+ *  ivec v;
+ *  ivec_init(&v);
+ *  ivec_push_back(&v, 1);
+ *  cstl_for_each(pos, n, &v, ivec)
+ *      ...
+ *  ivec_destroy(&v);
+ */
+#define CSTL_VECTOR_DEFINE(name, T) \
+typedef struct { \
+    size_t _size; \
+    size_t _used; \
+    size_t _capacity; \
+    uint32_t *_bitmap; \
+    T *_data; \
+} name; \
+ \
+static inline void name##_init(name *this) \
+{ \
+    memset(this, 0, sizeof(*this)); \
+} \
+ \
+static inline void name##_destroy(name *this) \
+{ \
+    size_t old = (this->_capacity + MASK) >> SHIFT; \
+ \
+    CSTL_FREE(this->_data, this->_data ? this->_capacity * sizeof(T) + !this->_capacity : 0); \
+    CSTL_FREE(this->_bitmap, this->_bitmap ? old * sizeof(uint32_t) + !old : 0); \
+    memset(this, 0, sizeof(*this)); \
+} \
+ \
+static inline bool name##_realloc(name *this, size_t capacity) \
+{ \
+    size_t words = (capacity + MASK) >> SHIFT; \
+    size_t old = (this->_capacity + MASK) >> SHIFT; \
+    T *data; \
+    uint32_t *map; \
+ \
+    data = (T *)CSTL_REALLOC(this->_data, this->_data ? this->_capacity * sizeof(T) + !this->_capacity : 0, \
+            capacity * sizeof(T) + !capacity); \
+    if (!data) \
+        return false; \
+    this->_data = data; \
+ \
+    map = (uint32_t *)CSTL_REALLOC(this->_bitmap, this->_bitmap ? old * sizeof(uint32_t) + !old : 0, \
+            words * sizeof(uint32_t) + !words); \
+    if (!map) \
+        return false; \
+    if (words > old) \
+        memset(map + old, 0, (words - old) * sizeof(uint32_t)); \
+    this->_bitmap = map; \
+    this->_capacity = capacity; \
+    return true; \
+} \
+ \
+static inline bool name##_reserve(name *this, size_t n) \
+{ \
+    return n <= this->_capacity ? true : name##_realloc(this, n); \
+} \
+ \
+static inline bool name##_shrink_to_fit(name *this) \
+{ \
+    return this->_size == this->_capacity ? true : name##_realloc(this, this->_size); \
+} \
+ \
+static inline size_t name##_size(const name *this) \
+{ \
+    return this->_size; \
+} \
+ \
+static inline bool name##_empty(const name *this) \
+{ \
+    return !this->_used; \
+} \
+ \
+static inline bool name##_alive(const name *this, size_t n) \
+{ \
+    return this->_bitmap[n >> SHIFT] & (1U << (n & MASK)); \
+} \
+ \
+static inline T *name##_at(name *this, size_t n) \
+{ \
+    return &this->_data[n]; \
+} \
+ \
+static inline bool name##_push_back(name *this, T ele) \
+{ \
+    if (this->_size == this->_capacity) { \
+        size_t capacity = this->_capacity / 100 * CSTL_GROWTH_FACTOR + this->_capacity % 100 * CSTL_GROWTH_FACTOR / 100; \
+        if (capacity < CSTL_MIN_CAPACITY) \
+            capacity = CSTL_MIN_CAPACITY; \
+        if (!name##_realloc(this, capacity)) \
+            return false; \
+    } \
+ \
+    this->_bitmap[this->_size >> SHIFT] |= 1U << (this->_size & MASK); \
+    this->_data[this->_size++] = ele; \
+    this->_used++; \
+    return true; \
+} \
+ \
+static inline bool name##_pop_back(name *this, T *ele) \
+{ \
+    size_t n = _bitmap_prev(this->_bitmap, this->_size, this->_size); \
+ \
+    if (n == (size_t)-1) { \
+        this->_size = 0; \
+        return false; \
+    } \
+ \
+    if (ele) \
+        *ele = this->_data[n]; \
+    this->_bitmap[n >> SHIFT] &= ~(1U << (n & MASK)); \
+    this->_size = n; \
+    this->_used--; \
+    return true; \
+} \
+ \
+static inline void name##_erase(name *this, size_t n) \
+{ \
+    if (name##_alive(this, n)) { \
+        this->_bitmap[n >> SHIFT] &= ~(1U << (n & MASK)); \
+        this->_used--; \
+    } \
+} \
+ \
+static inline void name##_clear(name *this) \
+{ \
+    if (this->_bitmap) \
+        memset(this->_bitmap, 0, ((this->_size + MASK) >> SHIFT) * sizeof(uint32_t)); \
+    this->_size = 0; \
+    this->_used = 0; \
+} \
+ \
+static inline T *name##_front(name *this) \
+{ \
+    size_t n = _bitmap_next(this->_bitmap, this->_size, 0); \
+ \
+    return n < this->_size ? &this->_data[n] : NULL; \
+} \
+ \
+static inline T *name##_back(name *this) \
+{ \
+    size_t n = _bitmap_prev(this->_bitmap, this->_size, this->_size); \
+ \
+    return n != (size_t)-1 ? &this->_data[n] : NULL; \
+} \
+ \
+static inline T *name##_next(name *this, size_t *n) \
+{ \
+    *n = _bitmap_next(this->_bitmap, this->_size, *n); \
+ \
+    return *n < this->_size ? &this->_data[*n] : NULL; \
+}
+
+/**
+ * cstl_for_each  - iterate over the live elements of a CSTL_VECTOR_DEFINE vector
+ * @pos:    the T * to use as a loop cursor.
+ * @n:      a size_t to use as the slot index.
+ * @vec:    the pointer for your vector.
+ * @name:   the name given to CSTL_VECTOR_DEFINE.
+ */
+#define cstl_for_each(pos, n, vec, name) \
+    for (n = 0, pos = name##_next(vec, &n); pos; n++, pos = name##_next(vec, &n))
+
+#define CSTL_QUEUE_DEFINE(name, T) \
+typedef struct { \
+    size_t _size; \
+    size_t _capacity; \
+    size_t _front; \
+    T *_data; \
+} name; \
+ \
+static inline void name##_init(name *this) \
+{ \
+    memset(this, 0, sizeof(*this)); \
+} \
+ \
+static inline void name##_destroy(name *this) \
+{ \
+    CSTL_FREE(this->_data, this->_capacity * sizeof(T)); \
+    memset(this, 0, sizeof(*this)); \
+} \
+ \
+static inline bool name##_realloc(name *this, size_t capacity) \
+{ \
+    size_t old = this->_capacity; \
+    T *data; \
+ \
+    data = (T *)CSTL_REALLOC(this->_data, old * sizeof(T), capacity * sizeof(T)); \
+    if (!data) \
+        return false; \
+ \
+    /* capacity at least doubles, so the wrapped head always fits right after the old end */ \
+    if (this->_front + this->_size > old) \
+        memcpy(data + old, data, (this->_front + this->_size - old) * sizeof(T)); \
+    this->_data = data; \
+    this->_capacity = capacity; \
+    return true; \
+} \
+ \
+static inline bool name##_reserve(name *this, size_t n) \
+{ \
+    size_t capacity = this->_capacity ? this->_capacity : 1; \
+ \
+    if (n <= this->_capacity) \
+        return true; \
+    while (capacity < n || capacity < CSTL_MIN_CAPACITY) \
+        capacity <<= 1; \
+ \
+    return name##_realloc(this, capacity); \
+} \
+ \
+static inline size_t name##_size(const name *this) \
+{ \
+    return this->_size; \
+} \
+ \
+static inline bool name##_empty(const name *this) \
+{ \
+    return !this->_size; \
+} \
+ \
+static inline bool name##_push(name *this, T ele) \
+{ \
+    if (this->_size == this->_capacity && !name##_reserve(this, this->_size + 1)) \
+        return false; \
+ \
+    this->_data[(this->_front + this->_size++) & (this->_capacity - 1)] = ele; \
+    return true; \
+} \
+ \
+static inline bool name##_pop(name *this, T *ele) \
+{ \
+    if (!this->_size) \
+        return false; \
+ \
+    if (ele) \
+        *ele = this->_data[this->_front]; \
+    this->_front = (this->_front + 1) & (this->_capacity - 1); \
+    this->_size--; \
+    return true; \
+} \
+ \
+static inline T *name##_front(name *this) \
+{ \
+    return this->_size ? &this->_data[this->_front] : NULL; \
+} \
+ \
+static inline T *name##_back(name *this) \
+{ \
+    return this->_size ? &this->_data[(this->_front + this->_size - 1) & (this->_capacity - 1)] : NULL; \
+} \
+ \
+static inline void name##_clear(name *this) \
+{ \
+    this->_front = 0; \
+    this->_size = 0; \
+}
+
 /* Functions */
 void vector_op_init(void);
 void queue_op_init(void);
 struct vector_t *vector_constructor(vector *v, uint32_t tlen);
+struct vector_t *vector_constructor_alloc(vector *v, uint32_t tlen, const cstl_allocator *alloc);
 struct queue_t *queue_constructor(queue *q, uint32_t tlen);
+struct queue_t *queue_constructor_alloc(queue *q, uint32_t tlen, const cstl_allocator *alloc);
 void vector_destructor(vector *v);
 void queue_destructor(queue *q);
+/* Call fn for every live vector and queue. fn runs under the registry lock and only gets the
+ * stats record, container identifies it but must not be dereferenced from another thread.
+ * Counters of containers owned by other threads may be read mid update.
+ */
+void cstl_stats_foreach(void (*fn)(void *ctx, int kind, void *container, const cstl_stats *st), void *ctx);
+#if CSTL_STATS
+/* for constructors outside cstl.c */
+void cstl_stats_register(int kind, void *container);
+void cstl_stats_unregister(int kind, void *container);
+#endif
 
 #endif
 /* EOF */
@@ -0,0 +1,520 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_algo.c
+*
+* DESCRIPTION:     Sort and search algorithms on vector
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include "cstl_algo.h"
+//===========================
+// Defines
+//===========================
+/* below this many elements the sort finishes with insertion sort */
+#define INSERTION_SORT          24
+/* ninther pivot above this many */
+#define NINTHER                 128
+/* a partial insertion sort gives up after moving this many elements */
+#define PARTIAL_LIMIT           8
+
+#define swap_ptr(a, b)          do { void *_t = (a); (a) = (b); (b) = _t; } while (0)
+#define less(cmp, ctx, a, b)    ((cmp)(ctx, a, b) < 0)
+
+//===========================
+// Typedefs
+//===========================
+struct radix_t {
+    uint64_t _key;
+    void *_ele;
+};
+
+//===========================
+// Locals
+//===========================
+static void _insertion_sort(void **a, size_t n, vector_compare cmp, void *ctx);
+static bool _partial_insertion_sort(void **a, size_t n, vector_compare cmp, void *ctx);
+static void _heap_sort(void **a, size_t n, vector_compare cmp, void *ctx);
+static void _sort3(void **a, size_t i, size_t j, size_t k, vector_compare cmp, void *ctx);
+static size_t _partition_right(void **a, size_t n, bool *already, vector_compare cmp, void *ctx);
+static size_t _partition_left(void **a, size_t n, vector_compare cmp, void *ctx);
+static void _pdq_sort(void **a, size_t n, int depth, bool leftmost, vector_compare cmp, void *ctx);
+static size_t _bound(vector *v, const void *key, vector_compare cmp, void *ctx, int strict);
+
+//===========================
+// Globals
+//===========================
+
+/*
+ * Keys are taken once into (key, element) pairs, all eight byte histograms come from one
+ * pass over them, then every byte position whose histogram isn't a single bucket scatters
+ * the pairs between two buffers.
+ */
+//=============================================================================
+inline bool
+vector_radix_sort(
+    vector *v,
+    vector_key key
+)
+//=============================================================================
+{
+    struct radix_t *src, *dst, *tmp;
+    size_t (*hist)[256];
+    size_t n, i, b, sum, cnt;
+    void **a;
+
+    vop.compact(v);
+    n = v->_vector->_size;
+    if (n < 2)
+        return true;
+
+    a = v->_vector->_vector;
+    src = (struct radix_t *)malloc(n * sizeof(struct radix_t));
+    dst = (struct radix_t *)malloc(n * sizeof(struct radix_t));
+    hist = (size_t (*)[256])calloc(8, sizeof(*hist));
+    if (!src || !dst || !hist) {
+        free(src);
+        free(dst);
+        free(hist);
+        return false;
+    }
+
+    for (i = 0; i < n; i++) {
+        src[i]._key = key(a[i]);
+        src[i]._ele = a[i];
+        for (b = 0; b < 8; b++)
+            hist[b][(src[i]._key >> (b * 8)) & 0xff]++;
+    }
+
+    for (b = 0; b < 8; b++) {
+        if (hist[b][(src[0]._key >> (b * 8)) & 0xff] == n)
+            continue;
+        for (i = 0, sum = 0; i < 256; i++) {
+            cnt = hist[b][i];
+            hist[b][i] = sum;
+            sum += cnt;
+        }
+        for (i = 0; i < n; i++)
+            dst[hist[b][(src[i]._key >> (b * 8)) & 0xff]++] = src[i];
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    for (i = 0; i < n; i++)
+        a[i] = src[i]._ele;
+
+    free(src);
+    free(dst);
+    free(hist);
+    return true;
+}
+
+//=============================================================================
+inline void
+vector_sort(
+    vector *v,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    size_t n;
+    int depth = 0;
+
+    vop.compact(v);
+    n = v->_vector->_size;
+    for (; n > 1; n >>= 1)
+        depth += 2;
+
+    _pdq_sort(v->_vector->_vector, v->_vector->_size, depth, true, cmp, ctx);
+}
+
+//=============================================================================
+inline size_t
+vector_lower_bound(
+    vector *v,
+    const void *key,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    return _bound(v, key, cmp, ctx, 0);
+}
+
+//=============================================================================
+inline size_t
+vector_upper_bound(
+    vector *v,
+    const void *key,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    return _bound(v, key, cmp, ctx, 1);
+}
+
+/*
+ * Whole bitmap words at a time, 32 slots are compared at once (AVX2 4, SSE2 2 per compare)
+ * into an equality mask that is then anded with the occupancy word. Empty words are skipped
+ * without touching the elements.
+ */
+//=============================================================================
+inline size_t
+vector_find(
+    vector *v,
+    const void *ele
+)
+//=============================================================================
+{
+    const uint32_t *map = v->_vector->_bitmap->_bitmap;
+    void **a = v->_vector->_vector;
+    size_t size = v->_vector->_size;
+    size_t full = size >> SHIFT;
+    size_t w, i;
+    uint32_t eq;
+#if defined(__AVX2__)
+    __m256i needle = _mm256_set1_epi64x((int64_t)(uintptr_t)ele);
+#elif defined(__SSE2__)
+    __m128i needle = _mm_set1_epi64x((int64_t)(uintptr_t)ele);
+    __m128i x;
+#endif
+
+    for (w = 0; w < full; w++) {
+        if (!map[w])
+            continue;
+        eq = 0;
+#if defined(__AVX2__)
+        for (i = 0; i < 32; i += 4)
+            eq |= (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(a + (w << SHIFT) + i)), needle))) << i;
+#elif defined(__SSE2__)
+        for (i = 0; i < 32; i += 2) {
+            /* no 64 bit compare in SSE2, both 32 bit halves have to match */
+            x = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + (w << SHIFT) + i)), needle);
+            x = _mm_and_si128(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+            eq |= (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(x)) << i;
+        }
+#else
+        for (i = 0; i < 32; i++)
+            eq |= (uint32_t)(a[(w << SHIFT) + i] == ele) << i;
+#endif
+        eq &= map[w];
+        if (eq)
+            return (w << SHIFT) + __builtin_ctz(eq);
+    }
+
+    for (i = full << SHIFT; i < size; i++) {
+        if ((map[i >> SHIFT] & (1U << (i & MASK))) && a[i] == ele)
+            return i;
+    }
+
+    return size;
+}
+
+//=============================================================================
+static void
+_insertion_sort(
+    void **a,
+    size_t n,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    size_t i, j;
+    void *t;
+
+    for (i = 1; i < n; i++) {
+        t = a[i];
+        for (j = i; j > 0 && less(cmp, ctx, t, a[j - 1]); j--)
+            a[j] = a[j - 1];
+        a[j] = t;
+    }
+}
+
+/* Insertion sort that gives up once it moved PARTIAL_LIMIT elements, true if a is sorted. */
+//=============================================================================
+static bool
+_partial_insertion_sort(
+    void **a,
+    size_t n,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    size_t i, j, moved = 0;
+    void *t;
+
+    for (i = 1; i < n; i++) {
+        if (!less(cmp, ctx, a[i], a[i - 1]))
+            continue;
+        t = a[i];
+        for (j = i; j > 0 && less(cmp, ctx, t, a[j - 1]); j--)
+            a[j] = a[j - 1];
+        a[j] = t;
+        moved += i - j;
+        if (moved > PARTIAL_LIMIT)
+            return false;
+    }
+
+    return true;
+}
+
+//=============================================================================
+static void
+_heap_sort(
+    void **a,
+    size_t n,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    size_t i, end, root, child;
+
+    for (i = n / 2; i-- > 0;) {
+        for (root = i; (child = root * 2 + 1) < n; root = child) {
+            if (child + 1 < n && less(cmp, ctx, a[child], a[child + 1]))
+                child++;
+            if (!less(cmp, ctx, a[root], a[child]))
+                break;
+            swap_ptr(a[root], a[child]);
+        }
+    }
+
+    for (end = n; end-- > 1;) {
+        swap_ptr(a[0], a[end]);
+        for (root = 0; (child = root * 2 + 1) < end; root = child) {
+            if (child + 1 < end && less(cmp, ctx, a[child], a[child + 1]))
+                child++;
+            if (!less(cmp, ctx, a[root], a[child]))
+                break;
+            swap_ptr(a[root], a[child]);
+        }
+    }
+}
+
+//=============================================================================
+static void
+_sort3(
+    void **a,
+    size_t i,
+    size_t j,
+    size_t k,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    if (less(cmp, ctx, a[j], a[i]))
+        swap_ptr(a[i], a[j]);
+    if (less(cmp, ctx, a[k], a[j]))
+        swap_ptr(a[j], a[k]);
+    if (less(cmp, ctx, a[j], a[i]))
+        swap_ptr(a[i], a[j]);
+}
+
+/*
+ * Pivot in a[0]. Afterwards [0, p) < pivot <= [p + 1, n) and the pivot sits at p. *already
+ * tells whether no element had to be swapped.
+ */
+//=============================================================================
+static size_t
+_partition_right(
+    void **a,
+    size_t n,
+    bool *already,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    void *pivot = a[0];
+    size_t i = 1, j = n - 1;
+
+    while (i <= j && less(cmp, ctx, a[i], pivot))
+        i++;
+    while (i <= j && !less(cmp, ctx, a[j], pivot))
+        j--;
+    *already = i > j;
+
+    /* from here on a[i] >= pivot and a[j] < pivot bound both scans */
+    while (i < j) {
+        swap_ptr(a[i], a[j]);
+        while (less(cmp, ctx, a[++i], pivot))
+            ;
+        while (!less(cmp, ctx, a[--j], pivot))
+            ;
+    }
+
+    swap_ptr(a[0], a[j]);
+    return j;
+}
+
+/* Pivot in a[0], [0, p) <= pivot < [p + 1, n). Used when many elements equal the pivot. */
+//=============================================================================
+static size_t
+_partition_left(
+    void **a,
+    size_t n,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    void *pivot = a[0];
+    size_t i = 1, j = n - 1;
+
+    while (i <= j && !less(cmp, ctx, pivot, a[i]))
+        i++;
+    while (i <= j && less(cmp, ctx, pivot, a[j]))
+        j--;
+
+    while (i < j) {
+        swap_ptr(a[i], a[j]);
+        while (!less(cmp, ctx, pivot, a[++i]))
+            ;
+        while (less(cmp, ctx, pivot, a[--j]))
+            ;
+    }
+
+    swap_ptr(a[0], a[j]);
+    return j;
+}
+
+/*
+ * Introsort with the pattern defeating tricks: ninther pivots, equal runs swept in one go
+ * when the pivot equals the element before this range, a few elements swapped around after
+ * a badly unbalanced split, a partial insertion sort on splits that needed no swap, and heap
+ * sort once depth runs out. leftmost is false when a[-1] exists and is <= every element.
+ */
+//=============================================================================
+static void
+_pdq_sort(
+    void **a,
+    size_t n,
+    int depth,
+    bool leftmost,
+    vector_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    size_t p, l, r, s;
+    bool already;
+
+    while (n > INSERTION_SORT) {
+        if (depth-- <= 0) {
+            _heap_sort(a, n, cmp, ctx);
+            return;
+        }
+
+        s = n / 2;
+        if (n > NINTHER) {
+            _sort3(a, 0, s, n - 1, cmp, ctx);
+            _sort3(a, 1, s - 1, n - 2, cmp, ctx);
+            _sort3(a, 2, s + 1, n - 3, cmp, ctx);
+            _sort3(a, s - 1, s, s + 1, cmp, ctx);
+        }
+        else {
+            _sort3(a, 0, s, n - 1, cmp, ctx);
+        }
+        swap_ptr(a[0], a[s]);
+
+        if (!leftmost && !less(cmp, ctx, a[-1], a[0])) {
+            p = _partition_left(a, n, cmp, ctx);
+            a += p + 1;
+            n -= p + 1;
+            continue;
+        }
+
+        p = _partition_right(a, n, &already, cmp, ctx);
+        l = p;
+        r = n - p - 1;
+
+        if (l < n / 8 || r < n / 8) {
+            if (l >= INSERTION_SORT) {
+                swap_ptr(a[0], a[l / 4]);
+                swap_ptr(a[p - 1], a[p - l / 4]);
+            }
+            if (r >= INSERTION_SORT) {
+                swap_ptr(a[p + 1], a[p + 1 + r / 4]);
+                swap_ptr(a[n - 1], a[n - r / 4]);
+            }
+        }
+        else if (already && _partial_insertion_sort(a, p, cmp, ctx) && _partial_insertion_sort(a + p + 1, r, cmp, ctx)) {
+            return;
+        }
+
+        /* recurse into the smaller side, loop on the larger */
+        if (l < r) {
+            _pdq_sort(a, l, depth, leftmost, cmp, ctx);
+            a += p + 1;
+            n = r;
+            leftmost = false;
+        }
+        else {
+            _pdq_sort(a + p + 1, r, depth, false, cmp, ctx);
+            n = l;
+        }
+    }
+
+    _insertion_sort(a, n, cmp, ctx);
+}
+
+/*
+ * Binary search over slot indexes. A probe that lands on a tombstone moves to the next live
+ * slot before hi, with none there the upper half holds nothing and is dropped.
+ */
+//=============================================================================
+static size_t
+_bound(
+    vector *v,
+    const void *key,
+    vector_compare cmp,
+    void *ctx,
+    int strict
+)
+//=============================================================================
+{
+    const uint32_t *map = v->_vector->_bitmap->_bitmap;
+    void **a = v->_vector->_vector;
+    size_t lo = 0, hi = v->_vector->_size;
+    size_t mid, m;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        m = _bitmap_next(map, hi, mid);
+        if (m == hi) {
+            hi = mid;
+            continue;
+        }
+        if (cmp(ctx, a[m], key) < strict)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+
+    return _bit_next_v(v, lo);
+}
+
+/* EOF */
@@ -0,0 +1,70 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_algo.h
+*
+* DESCRIPTION:     Sort and search algorithms on vector
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_ALGO_H__
+#define __CSTL_ALGO_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+/* < 0, 0, > 0 as a sorts before, with or after b */
+typedef int (*vector_compare)(void *ctx, const void *a, const void *b);
+/* unsigned integer sort key of an element */
+typedef uint64_t (*vector_key)(const void *ele);
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+/*
+ * The sorts compact the vector first (vop.compact, relocation callback included), then
+ * order the dense elements in place, so indexes are only meaningful again afterwards.
+ */
+/* LSD radix sort on key, stable, byte passes every key agrees on are skipped. false if out of memory */
+bool vector_radix_sort(vector *v, vector_key key);
+/* pattern defeating introsort, not stable, O(n log n) worst case */
+void vector_sort(vector *v, vector_compare cmp, void *ctx);
+/*
+ * On a vector whose live elements are sorted by cmp, tombstones are stepped over. cmp is
+ * called as cmp(ctx, ele, key). Both return a live slot or _size.
+ */
+size_t vector_lower_bound(vector *v, const void *key, vector_compare cmp, void *ctx);
+size_t vector_upper_bound(vector *v, const void *key, vector_compare cmp, void *ctx);
+/* first live slot holding exactly ele, compared as a pointer sized value, or _size */
+size_t vector_find(vector *v, const void *ele);
+
+#endif
+/* EOF */
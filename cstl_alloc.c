@@ -0,0 +1,499 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_alloc.c
+*
+* DESCRIPTION:     Arena, thread local pool and huge page allocators
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "cstl_alloc.h"
+//===========================
+// Defines
+//===========================
+#define align_up(n, a)          (((n) + (a) - 1) & ~((size_t)(a) - 1))
+#define huge_len(n)             align_up(n, CSTL_HUGE_PAGE)
+#define huge_config(ctx)        ((ctx) ? (const cstl_huge_config *)(ctx) : &huge_default)
+#define chunk_hdr               align_up(sizeof(struct arena_chunk_t), CSTL_ARENA_ALIGN)
+#define chunk_data(c)           ((uint8_t *)(c) + chunk_hdr)
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+static __thread struct {
+    void *_free;
+    size_t _cnt;
+    bool _keyed;
+} pool;
+/* frees what an exiting thread still has cached, the list itself is only reachable from it */
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void *_arena_alloc(void *ctx, size_t size);
+static void *_arena_realloc(void *ctx, void *ptr, size_t old, size_t size);
+static void _arena_free(void *ctx, void *ptr, size_t size);
+static void *_pool_alloc(void *ctx, size_t size);
+static void *_pool_realloc(void *ctx, void *ptr, size_t old, size_t size);
+static void _pool_free(void *ctx, void *ptr, size_t size);
+static void _release_pool(void *p);
+static void _pool_init(void);
+static void *_huge_alloc(void *ctx, size_t size);
+static void *_huge_realloc(void *ctx, void *ptr, size_t old, size_t size);
+static void _huge_free(void *ctx, void *ptr, size_t size);
+static void *_huge_map(size_t len, uint32_t flags);
+static void _huge_advise(uint8_t *ptr, size_t len, uint32_t flags);
+
+static const cstl_huge_config huge_default = { CSTL_HUGE_THRESHOLD, 0 };
+
+//===========================
+// Globals
+//===========================
+const cstl_allocator cstl_pool_allocator = { _pool_alloc, _pool_realloc, _pool_free, NULL };
+const cstl_allocator cstl_huge_allocator = { _huge_alloc, _huge_realloc, _huge_free, NULL };
+
+/* Functions */
+
+/* chunk is the default size of the blocks the arena takes from malloc */
+//=============================================================================
+inline struct arena_t *
+arena_constructor(
+    arena *a,
+    size_t chunk
+)
+//=============================================================================
+{
+    a->_arena = (struct arena_t *)calloc(1, sizeof(struct arena_t));
+    if (!a->_arena)
+        return NULL;
+
+    a->_arena->_allocator.alloc = _arena_alloc;
+    a->_arena->_allocator.realloc = _arena_realloc;
+    a->_arena->_allocator.free = _arena_free;
+    a->_arena->_allocator.ctx = a->_arena;
+    a->_arena->_chunk = chunk;
+
+    debug(LOG_DEBUG, "arena constructor: a: %p, _a: %p, chunk: %ld", a, a->_arena, chunk);
+    return a->_arena;
+}
+
+//=============================================================================
+inline void
+arena_destructor(
+    arena *a
+)
+//=============================================================================
+{
+    struct arena_chunk_t *c, *next;
+
+    if (!a->_arena)
+        return;
+
+    for (c = a->_arena->_head; c; c = next) {
+        next = c->_next;
+        free(c);
+    }
+    free(a->_arena);
+    a->_arena = NULL;
+}
+
+/* Drop everything allocated so far, the newest chunk is kept for reuse. */
+//=============================================================================
+inline void
+arena_reset(
+    arena *a
+)
+//=============================================================================
+{
+    struct arena_chunk_t *c, *next;
+
+    if (!a->_arena->_head)
+        return;
+
+    for (c = a->_arena->_head->_next; c; c = next) {
+        next = c->_next;
+        free(c);
+    }
+    a->_arena->_head->_next = NULL;
+    a->_arena->_head->_used = 0;
+    a->_arena->_last = NULL;
+}
+
+//=============================================================================
+inline const cstl_allocator *
+arena_allocator(
+    arena *a
+)
+//=============================================================================
+{
+    return &a->_arena->_allocator;
+}
+
+/* Give the calling thread's cached pool blocks back to malloc. */
+//=============================================================================
+inline void
+cstl_pool_trim(
+    void
+)
+//=============================================================================
+{
+    void *next;
+
+    while (pool._free) {
+        next = *(void **)pool._free;
+        free(pool._free);
+        pool._free = next;
+    }
+    pool._cnt = 0;
+}
+
+//=============================================================================
+static void *
+_arena_alloc(
+    void *ctx,
+    size_t size
+)
+//=============================================================================
+{
+    struct arena_t *a = (struct arena_t *)ctx;
+    struct arena_chunk_t *c = a->_head;
+    size_t len = align_up(size, CSTL_ARENA_ALIGN);
+    size_t csz;
+    void *ptr;
+
+    if (!c || c->_used + len > c->_size) {
+        csz = len > a->_chunk ? len : a->_chunk;
+        c = (struct arena_chunk_t *)malloc(chunk_hdr + csz);
+        if (!c)
+            return NULL;
+        c->_size = csz;
+        c->_used = 0;
+        c->_next = a->_head;
+        a->_head = c;
+    }
+
+    ptr = chunk_data(c) + c->_used;
+    c->_used += len;
+    a->_last = ptr;
+    return ptr;
+}
+
+//=============================================================================
+static void *
+_arena_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old,
+    size_t size
+)
+//=============================================================================
+{
+    struct arena_t *a = (struct arena_t *)ctx;
+    struct arena_chunk_t *c = a->_head;
+    size_t olen = align_up(old, CSTL_ARENA_ALIGN);
+    size_t len = align_up(size, CSTL_ARENA_ALIGN);
+    void *nptr;
+
+    if (!ptr)
+        return _arena_alloc(ctx, size);
+
+    /* the newest block grows and shrinks in place while its chunk has room */
+    if (ptr == a->_last && c->_used - olen + len <= c->_size) {
+        c->_used = c->_used - olen + len;
+        return ptr;
+    }
+    if (size <= old)
+        return ptr;
+
+    nptr = _arena_alloc(ctx, size);
+    if (nptr)
+        memcpy(nptr, ptr, old);
+
+    return nptr;
+}
+
+//=============================================================================
+static void
+_arena_free(
+    void *ctx,
+    void *ptr,
+    size_t size
+)
+//=============================================================================
+{
+    struct arena_t *a = (struct arena_t *)ctx;
+
+    if (ptr && ptr == a->_last) {
+        a->_head->_used -= align_up(size, CSTL_ARENA_ALIGN);
+        a->_last = NULL;
+    }
+}
+
+//=============================================================================
+static void *
+_pool_alloc(
+    void *ctx,
+    size_t size
+)
+//=============================================================================
+{
+    void *ptr;
+
+    if (size > CSTL_POOL_BLOCK)
+        return malloc(size);
+
+    if (pool._free) {
+        ptr = pool._free;
+        pool._free = *(void **)ptr;
+        pool._cnt--;
+        return ptr;
+    }
+
+    return malloc(CSTL_POOL_BLOCK);
+}
+
+/* a pool block is just a malloc block of CSTL_POOL_BLOCK bytes, so moving across the
+ * threshold is a plain realloc either way
+ */
+//=============================================================================
+static void *
+_pool_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old,
+    size_t size
+)
+//=============================================================================
+{
+    if (!ptr)
+        return _pool_alloc(ctx, size);
+    if (old <= CSTL_POOL_BLOCK && size <= CSTL_POOL_BLOCK)
+        return ptr;
+
+    return realloc(ptr, size > CSTL_POOL_BLOCK ? size : CSTL_POOL_BLOCK);
+}
+
+//=============================================================================
+static void
+_pool_free(
+    void *ctx,
+    void *ptr,
+    size_t size
+)
+//=============================================================================
+{
+    if (!ptr)
+        return;
+
+    if (size > CSTL_POOL_BLOCK || pool._cnt >= CSTL_POOL_CACHE) {
+        free(ptr);
+        return;
+    }
+
+    if (!pool._keyed) {
+        pthread_once(&pool_once, _pool_init);
+        pthread_setspecific(pool_key, &pool);
+        pool._keyed = true;
+    }
+
+    *(void **)ptr = pool._free;
+    pool._free = ptr;
+    pool._cnt++;
+}
+
+/* runs at thread exit, the thread local list is still there until every destructor is done */
+//=============================================================================
+static void
+_release_pool(
+    void *p
+)
+//=============================================================================
+{
+    cstl_pool_trim();
+    pool._keyed = false;
+}
+
+//=============================================================================
+static void
+_pool_init(
+    void
+)
+//=============================================================================
+{
+    pthread_key_create(&pool_key, _release_pool);
+}
+
+/* whether a block is mapped only depends on its size, which every call is told */
+//=============================================================================
+static void *
+_huge_alloc(
+    void *ctx,
+    size_t size
+)
+//=============================================================================
+{
+    const cstl_huge_config *cfg = huge_config(ctx);
+
+    if (size < cfg->threshold)
+        return malloc(size);
+
+    return _huge_map(huge_len(size), cfg->flags);
+}
+
+/*
+ * Mapped to mapped never copies, mremap moves the page tables if the mapping can't grow in
+ * place. Crossing the threshold either way copies once between malloc and a mapping.
+ */
+//=============================================================================
+static void *
+_huge_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old,
+    size_t size
+)
+//=============================================================================
+{
+    const cstl_huge_config *cfg = huge_config(ctx);
+    size_t olen = huge_len(old);
+    size_t len = huge_len(size);
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t keep;
+    void *nptr;
+    void *dst;
+
+    if (!ptr)
+        return _huge_alloc(ctx, size);
+
+    if (old < cfg->threshold || size < cfg->threshold) {
+        if (old < cfg->threshold && size < cfg->threshold)
+            return realloc(ptr, size);
+        nptr = _huge_alloc(ctx, size);
+        if (!nptr)
+            return NULL;
+        memcpy(nptr, ptr, old < size ? old : size);
+        _huge_free(ctx, ptr, old);
+        return nptr;
+    }
+
+    if (len > olen) {
+        /* a plain MAYMOVE may land anywhere, a move goes into an aligned range mapped for it */
+        nptr = mremap(ptr, olen, len, 0);
+        if (nptr == MAP_FAILED) {
+            dst = _huge_map(len, 0);
+            if (!dst)
+                return NULL;
+            nptr = mremap(ptr, olen, len, MREMAP_MAYMOVE | MREMAP_FIXED, dst);
+            if (nptr == MAP_FAILED) {
+                munmap(dst, len);
+                return NULL;
+            }
+        }
+        /* the advice belongs to the mapping, it is only the new tail that needs populating */
+        _huge_advise((uint8_t *)nptr + olen, len - olen, cfg->flags);
+        return nptr;
+    }
+
+    /* whole huge pages past the end are unmapped, the pages behind size are just dropped */
+    if (len < olen)
+        munmap((uint8_t *)ptr + len, olen - len);
+    keep = align_up(size, page);
+    if (keep < len && size < old)
+        madvise((uint8_t *)ptr + keep, len - keep, MADV_DONTNEED);
+
+    return ptr;
+}
+
+//=============================================================================
+static void
+_huge_free(
+    void *ctx,
+    void *ptr,
+    size_t size
+)
+//=============================================================================
+{
+    if (!ptr)
+        return;
+
+    if (size < huge_config(ctx)->threshold)
+        free(ptr);
+    else
+        munmap(ptr, huge_len(size));
+}
+
+/* len is a multiple of CSTL_HUGE_PAGE, the mapping is aligned to it so every page can be huge */
+//=============================================================================
+static void *
+_huge_map(
+    size_t len,
+    uint32_t flags
+)
+//=============================================================================
+{
+    uint8_t *base;
+    uint8_t *ptr;
+
+    base = mmap(NULL, len + CSTL_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    ptr = (uint8_t *)align_up((uintptr_t)base, CSTL_HUGE_PAGE);
+    if (ptr > base)
+        munmap(base, ptr - base);
+    munmap(ptr + len, base + CSTL_HUGE_PAGE - ptr);
+
+#ifndef MADV_POPULATE_WRITE
+    /* no way to populate after the advice, map the range again with MAP_POPULATE */
+    if ((flags & CSTL_HUGE_POPULATE) &&
+            mmap(ptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_POPULATE, -1, 0) == MAP_FAILED) {
+        munmap(ptr, len);
+        return NULL;
+    }
+#endif
+    _huge_advise(ptr, len, flags);
+    return ptr;
+}
+
+/* a kernel without THP or populate support just gets normal pages, the advice isn't checked */
+//=============================================================================
+static void
+_huge_advise(
+    uint8_t *ptr,
+    size_t len,
+    uint32_t flags
+)
+//=============================================================================
+{
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_POPULATE_WRITE
+    if (flags & CSTL_HUGE_POPULATE)
+        madvise(ptr, len, MADV_POPULATE_WRITE);
+#endif
+}
+
+/* EOF */
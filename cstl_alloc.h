@@ -0,0 +1,105 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_alloc.h
+*
+* DESCRIPTION:     Arena, thread local pool and huge page allocators
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_ALLOC_H__
+#define __CSTL_ALLOC_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+#define CSTL_ARENA_ALIGN        16
+/* blocks up to this size come from the calling thread's pool */
+#define CSTL_POOL_BLOCK         256
+/* free blocks a thread keeps around before handing them back to malloc */
+#define CSTL_POOL_CACHE         256
+/* huge blocks are mapped in multiples of a transparent huge page */
+#define CSTL_HUGE_PAGE          (2UL << 20)
+/* smallest block cstl_huge_allocator maps when its ctx is NULL */
+#define CSTL_HUGE_THRESHOLD     CSTL_HUGE_PAGE
+/* cstl_huge_config.flags */
+#define CSTL_HUGE_POPULATE      0x1     /* prefault a mapping when it is created or grown */
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Bump allocator, memory is only given back all at once by arena_reset or the destructor.
+ * The most recent allocation can still grow or be freed in place, which is what a
+ * container growing at the end of a request does most of the time. Not thread safe.
+ */
+typedef struct {
+    struct arena_t {
+        cstl_allocator _allocator;
+        size_t _chunk;
+        void *_last;
+        struct arena_chunk_t {
+            struct arena_chunk_t *_next;
+            size_t _size;
+            size_t _used;
+        } *_head;
+    } *_arena;
+} arena;
+
+/*
+ * ctx of cstl_huge_allocator. Copy the allocator and point its ctx at one of these to change
+ * the threshold or turn prefaulting on, the config must stay valid as long as the allocator.
+ */
+typedef struct {
+    size_t threshold;
+    uint32_t flags;
+} cstl_huge_config;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+/*
+ * Small blocks are cached on a per thread free list instead of going back to malloc, so
+ * creating and destroying containers doesn't touch the malloc lock in steady state. Every
+ * block is a plain malloc block, so it may be freed from any thread. A thread's list is
+ * freed when it exits, cstl_pool_trim frees it earlier.
+ */
+extern const cstl_allocator cstl_pool_allocator;
+/*
+ * Blocks from the threshold up are anonymous mappings advised for transparent huge pages.
+ * They are aligned to CSTL_HUGE_PAGE and stay aligned when they grow. Growing uses mremap,
+ * so the contents are never copied, and shrinking hands the pages back to the kernel.
+ * Smaller blocks come from malloc.
+ */
+extern const cstl_allocator cstl_huge_allocator;
+
+/* Functions */
+struct arena_t *arena_constructor(arena *a, size_t chunk);
+void arena_destructor(arena *a);
+void arena_reset(arena *a);
+const cstl_allocator *arena_allocator(arena *a);
+void cstl_pool_trim(void);
+
+#endif
+/* EOF */
@@ -0,0 +1,261 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_bqueue.c
+*
+* DESCRIPTION:     Blocking queue with coalesced eventfd wake-ups
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "cstl_bqueue.h"
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+bqueue_operation bqop;
+
+/* Functions */
+static bool _empty_bq(bqueue *this);
+static size_t _size_bq(bqueue *this);
+static bool _push_bq(bqueue *this, void *ele);
+static bool _pop_wait_bq(bqueue *this, void **ele, int timeout);
+static size_t _pop_batch_wait_bq(bqueue *this, void **eles, size_t n, int timeout);
+static int _fd_bq(bqueue *this);
+static bool _wait_bq(bqueue *this, int timeout, struct timespec *start);
+
+//=============================================================================
+inline void
+bqueue_op_init(
+    void
+)
+//=============================================================================
+{
+    queue_op_init();
+
+    bqop.empty = _empty_bq;
+    bqop.size = _size_bq;
+    bqop.push = _push_bq;
+    bqop.pop_wait = _pop_wait_bq;
+    bqop.pop_batch_wait = _pop_batch_wait_bq;
+    bqop.fd = _fd_bq;
+}
+
+//=============================================================================
+inline struct bqueue_t *
+bqueue_constructor(
+    bqueue *q,
+    uint32_t tlen
+)
+//=============================================================================
+{
+    q->_bqueue = (struct bqueue_t *)calloc(1, sizeof(struct bqueue_t));
+    if (!q->_bqueue)
+        return NULL;
+
+    q->_bqueue->_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (q->_bqueue->_efd < 0 || !queue_constructor(&q->_bqueue->_queue, tlen)) {
+        if (q->_bqueue->_efd >= 0)
+            close(q->_bqueue->_efd);
+        free(q->_bqueue);
+        q->_bqueue = NULL;
+        return NULL;
+    }
+    pthread_mutex_init(&q->_bqueue->_lock, NULL);
+
+    debug(LOG_DEBUG, "bqueue constructor: q: %p, _q: %p, efd: %ld", q, q->_bqueue, q->_bqueue->_efd);
+    return q->_bqueue;
+}
+
+//=============================================================================
+inline void
+bqueue_destructor(
+    bqueue *q
+)
+//=============================================================================
+{
+    if (!q->_bqueue)
+        return;
+
+    queue_destructor(&q->_bqueue->_queue);
+    pthread_mutex_destroy(&q->_bqueue->_lock);
+    close(q->_bqueue->_efd);
+    free(q->_bqueue);
+    q->_bqueue = NULL;
+}
+
+//=============================================================================
+static bool
+_empty_bq(
+    bqueue *this
+)
+//=============================================================================
+{
+    return _size_bq(this) ? false : true;
+}
+
+//=============================================================================
+static size_t
+_size_bq(
+    bqueue *this
+)
+//=============================================================================
+{
+    size_t size;
+
+    pthread_mutex_lock(&this->_bqueue->_lock);
+    size = qop.size(&this->_bqueue->_queue);
+    pthread_mutex_unlock(&this->_bqueue->_lock);
+
+    return size;
+}
+
+//=============================================================================
+static bool
+_push_bq(
+    bqueue *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct bqueue_t *bq = this->_bqueue;
+    uint64_t one = 1;
+    bool rc;
+
+    pthread_mutex_lock(&bq->_lock);
+    rc = qop.push(&bq->_queue, ele);
+    if (rc && !bq->_signaled) {
+        if (write(bq->_efd, &one, sizeof(one)) == sizeof(one))
+            bq->_signaled = true;
+    }
+    pthread_mutex_unlock(&bq->_lock);
+
+    return rc;
+}
+
+/* Pop one element, waiting up to timeout milliseconds for it, -1 waits forever and 0 doesn't
+ * wait at all. Returns false on timeout.
+ */
+//=============================================================================
+static bool
+_pop_wait_bq(
+    bqueue *this,
+    void **ele,
+    int timeout
+)
+//=============================================================================
+{
+    return _pop_batch_wait_bq(this, ele, 1, timeout) ? true : false;
+}
+
+/* Pop up to n elements into eles once at least one is there, waiting up to timeout
+ * milliseconds like pop_wait. Returns how many were popped, 0 on timeout.
+ */
+//=============================================================================
+static size_t
+_pop_batch_wait_bq(
+    bqueue *this,
+    void **eles,
+    size_t n,
+    int timeout
+)
+//=============================================================================
+{
+    struct bqueue_t *bq = this->_bqueue;
+    struct timespec start;
+    uint64_t cnt;
+    size_t i = 0;
+
+    if (!n)
+        return 0;
+    if (timeout > 0)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (;;) {
+        pthread_mutex_lock(&bq->_lock);
+        while (i < n && !qop.empty(&bq->_queue)) {
+            eles[i++] = qop.front(&bq->_queue);
+            qop.pop(&bq->_queue);
+        }
+        if (bq->_signaled && qop.empty(&bq->_queue)) {
+            if (read(bq->_efd, &cnt, sizeof(cnt)) == sizeof(cnt) || errno == EAGAIN)
+                bq->_signaled = false;
+        }
+        pthread_mutex_unlock(&bq->_lock);
+
+        if (i || !_wait_bq(this, timeout, &start))
+            return i;
+    }
+}
+
+//=============================================================================
+static int
+_fd_bq(
+    bqueue *this
+)
+//=============================================================================
+{
+    return this->_bqueue->_efd;
+}
+
+/* Block until the eventfd turns readable, returns false once timeout has passed since start. */
+//=============================================================================
+static bool
+_wait_bq(
+    bqueue *this,
+    int timeout,
+    struct timespec *start
+)
+//=============================================================================
+{
+    struct pollfd pfd = { .fd = this->_bqueue->_efd, .events = POLLIN };
+    struct timespec now;
+    long left = timeout;
+
+    if (!timeout)
+        return false;
+
+    if (timeout > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left -= (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+        if (left <= 0)
+            return false;
+    }
+
+    if (poll(&pfd, 1, (int)left) < 0 && errno != EINTR)
+        return false;
+
+    return true;
+}
+
+/* EOF */
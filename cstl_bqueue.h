@@ -0,0 +1,78 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_bqueue.h
+*
+* DESCRIPTION:     Blocking queue with coalesced eventfd wake-ups
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_BQUEUE_H__
+#define __CSTL_BQUEUE_H__
+
+//===========================
+// Includes
+//===========================
+#include <pthread.h>
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * A queue guarded by a mutex with an eventfd that is readable exactly while the queue
+ * holds elements. Only the push that makes the queue non-empty writes the eventfd and
+ * only the pop that empties it reads it back, so a burst of pushes costs one wake-up.
+ * Consumers block in poll() on the same fd, and the fd can be put in an epoll set next
+ * to sockets, pop with timeout 0 once it reports EPOLLIN.
+ */
+typedef struct {
+    struct bqueue_t {
+        queue _queue;
+        pthread_mutex_t _lock;
+        int _efd;
+        bool _signaled;
+    } *_bqueue;
+} bqueue;
+
+typedef struct {
+    bool (*empty)(bqueue *this);
+    size_t (*size)(bqueue *this);
+    bool (*push)(bqueue *this, void *ele);
+    bool (*pop_wait)(bqueue *this, void **ele, int timeout);
+    size_t (*pop_batch_wait)(bqueue *this, void **eles, size_t n, int timeout);
+    int (*fd)(bqueue *this);
+} bqueue_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern bqueue_operation bqop;
+
+/* Functions */
+void bqueue_op_init(void);
+struct bqueue_t *bqueue_constructor(bqueue *q, uint32_t tlen);
+void bqueue_destructor(bqueue *q);
+
+#endif
+/* EOF */
@@ -0,0 +1,298 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_cvector.c
+*
+* DESCRIPTION:     Concurrent append only vector with stable element addresses
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include "cstl_cvector.h"
+//===========================
+// Defines
+//===========================
+#define segment_len(k)          (CSTL_CVECTOR_FIRST << (k))
+#define segment_bitmap(s, k)    ((atomic_uint *)((s) + segment_len(k)))
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+static size_t _locate_cv(size_t n, size_t *off);
+static void **_segment_cv(cvector *this, size_t k);
+
+//===========================
+// Globals
+//===========================
+cvector_operation cvop;
+
+/* Functions */
+static bool _empty_cv(cvector *this);
+static size_t _size_cv(cvector *this);
+static size_t _push_back_cv(cvector *this, void *ele);
+static void *_at_cv(cvector *this, size_t n);
+static void **_slot_cv(cvector *this, size_t n);
+static size_t _next_cv(cvector *this, size_t n);
+static bool _reserve_cv(cvector *this, size_t n);
+
+//=============================================================================
+inline void
+cvector_op_init(
+    void
+)
+//=============================================================================
+{
+    cvop.empty = _empty_cv;
+    cvop.size = _size_cv;
+    cvop.push_back = _push_back_cv;
+    cvop.at = _at_cv;
+    cvop.slot = _slot_cv;
+    cvop.next = _next_cv;
+    cvop.reserve = _reserve_cv;
+}
+
+//=============================================================================
+inline struct cvector_t *
+cvector_constructor(
+    cvector *v,
+    uint32_t tlen
+)
+//=============================================================================
+{
+    size_t k;
+
+    v->_cvector = (struct cvector_t *)aligned_alloc(CSTL_CACHELINE, sizeof(struct cvector_t));
+    if (v->_cvector) {
+        atomic_init(&v->_cvector->_size, 0);
+        v->_cvector->_type_len = tlen;
+        for (k = 0; k < CSTL_CVECTOR_SEGMENTS; k++)
+            atomic_init(&v->_cvector->_segment[k], NULL);
+    }
+
+    debug(LOG_DEBUG, "cvector constructor: v: %p, _v: %p", v, v->_cvector);
+    return v->_cvector;
+}
+
+/* no other thread may still be using the vector */
+//=============================================================================
+inline void
+cvector_destructor(
+    cvector *v
+)
+//=============================================================================
+{
+    size_t k;
+
+    if (!v->_cvector)
+        return;
+
+    for (k = 0; k < CSTL_CVECTOR_SEGMENTS; k++)
+        free(atomic_load_explicit(&v->_cvector->_segment[k], memory_order_relaxed));
+    free(v->_cvector);
+    v->_cvector = NULL;
+}
+
+/* size counts reserved indexes, some of them may not be published yet */
+//=============================================================================
+static bool
+_empty_cv(
+    cvector *this
+)
+//=============================================================================
+{
+    return _size_cv(this) ? false : true;
+}
+
+//=============================================================================
+static size_t
+_size_cv(
+    cvector *this
+)
+//=============================================================================
+{
+    return atomic_load_explicit(&this->_cvector->_size, memory_order_acquire);
+}
+
+/* Returns the index of the new element, or -1 if its segment couldn't be allocated. The
+ * index is used up either way, readers just never see it published.
+ */
+//=============================================================================
+static size_t
+_push_back_cv(
+    cvector *this,
+    void *ele
+)
+//=============================================================================
+{
+    size_t n = atomic_fetch_add_explicit(&this->_cvector->_size, 1, memory_order_relaxed);
+    size_t off;
+    size_t k = _locate_cv(n, &off);
+    void **seg = _segment_cv(this, k);
+
+    if (!seg)
+        return (size_t)-1;
+
+    seg[off] = ele;
+    atomic_fetch_or_explicit(&segment_bitmap(seg, k)[off >> SHIFT], 1U << (off & MASK), memory_order_release);
+    return n;
+}
+
+/* NULL while n is not published, use slot to tell that apart from a NULL element */
+//=============================================================================
+static void *
+_at_cv(
+    cvector *this,
+    size_t n
+)
+//=============================================================================
+{
+    void **slot = _slot_cv(this, n);
+
+    return slot ? *slot : NULL;
+}
+
+/* the address stays valid until the destructor */
+//=============================================================================
+static void **
+_slot_cv(
+    cvector *this,
+    size_t n
+)
+//=============================================================================
+{
+    size_t off;
+    size_t k = _locate_cv(n, &off);
+    void **seg;
+
+    if (n >= _size_cv(this))
+        return NULL;
+    seg = atomic_load_explicit(&this->_cvector->_segment[k], memory_order_acquire);
+    if (!seg)
+        return NULL;
+    if (!(atomic_load_explicit(&segment_bitmap(seg, k)[off >> SHIFT], memory_order_acquire) & (1U << (off & MASK))))
+        return NULL;
+
+    return seg + off;
+}
+
+/* First published index from n on, or size when there is none. Iterate with
+ * for (i = cvop.next(v, 0); i < end; i = cvop.next(v, i + 1))
+ */
+//=============================================================================
+static size_t
+_next_cv(
+    cvector *this,
+    size_t n
+)
+//=============================================================================
+{
+    size_t size = _size_cv(this);
+    size_t off;
+    size_t k;
+    uint32_t word;
+    void **seg;
+
+    while (n < size) {
+        k = _locate_cv(n, &off);
+        seg = atomic_load_explicit(&this->_cvector->_segment[k], memory_order_acquire);
+        if (!seg) {
+            n += segment_len(k) - off;
+            continue;
+        }
+        word = atomic_load_explicit(&segment_bitmap(seg, k)[off >> SHIFT], memory_order_acquire) >> (off & MASK);
+        if (word)
+            return n + __builtin_ctz(word) < size ? n + __builtin_ctz(word) : size;
+        n += 32 - (off & MASK);
+    }
+
+    return size;
+}
+
+/* allocate the segments for the first n indexes up front, push_back then never allocates */
+//=============================================================================
+static bool
+_reserve_cv(
+    cvector *this,
+    size_t n
+)
+//=============================================================================
+{
+    size_t off;
+    size_t k;
+    size_t last;
+
+    if (!n)
+        return true;
+
+    last = _locate_cv(n - 1, &off);
+    for (k = 0; k <= last; k++) {
+        if (!_segment_cv(this, k))
+            return false;
+    }
+
+    return true;
+}
+
+/* segment k starts at index (CSTL_CVECTOR_FIRST << k) - CSTL_CVECTOR_FIRST */
+//=============================================================================
+static size_t
+_locate_cv(
+    size_t n,
+    size_t *off
+)
+//=============================================================================
+{
+    size_t pos = n + CSTL_CVECTOR_FIRST;
+    size_t bit = 63 - __builtin_clzl(pos);
+
+    *off = pos - (1UL << bit);
+    return bit - CSTL_CVECTOR_SHIFT;
+}
+
+/* The first thread to need segment k allocates it, a thread losing the race frees its copy
+ * and uses the winner's.
+ */
+//=============================================================================
+static void **
+_segment_cv(
+    cvector *this,
+    size_t k
+)
+//=============================================================================
+{
+    void **seg = atomic_load_explicit(&this->_cvector->_segment[k], memory_order_acquire);
+    void **expected = NULL;
+
+    if (seg)
+        return seg;
+
+    seg = (void **)calloc(1, segment_len(k) * sizeof(void *) + (segment_len(k) >> SHIFT) * sizeof(atomic_uint));
+    if (!seg)
+        return NULL;
+    if (!atomic_compare_exchange_strong_explicit(&this->_cvector->_segment[k], &expected, seg, memory_order_acq_rel, memory_order_acquire)) {
+        free(seg);
+        seg = expected;
+    }
+
+    return seg;
+}
+
+/* EOF */
@@ -0,0 +1,83 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_cvector.h
+*
+* DESCRIPTION:     Concurrent append only vector with stable element addresses
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_CVECTOR_H__
+#define __CSTL_CVECTOR_H__
+
+//===========================
+// Includes
+//===========================
+#include <stdatomic.h>
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+/* segment k holds CSTL_CVECTOR_FIRST << k elements */
+#define CSTL_CVECTOR_SHIFT      6
+#define CSTL_CVECTOR_FIRST      (1UL << CSTL_CVECTOR_SHIFT)
+#define CSTL_CVECTOR_SEGMENTS   (64 - CSTL_CVECTOR_SHIFT)
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Vector any number of threads may push_back to and read from at the same time. An index
+ * is reserved with one fetch_add on _size, its segment is allocated by whoever gets there
+ * first and never moves, so the address of an element stays valid until the destructor.
+ * Each segment is followed by its bitmap, a slot's bit is set with release order after the
+ * element is written and readers only look at slots whose bit they see set. Elements can't
+ * be erased, the container only grows.
+ */
+typedef struct {
+    struct cvector_t {
+        _Alignas(CSTL_CACHELINE) atomic_size_t _size;
+        _Alignas(CSTL_CACHELINE) uint32_t _type_len;
+        _Atomic(void **) _segment[CSTL_CVECTOR_SEGMENTS];
+    } *_cvector;
+} cvector;
+
+typedef struct {
+    bool (*empty)(cvector *this);
+    size_t (*size)(cvector *this);
+    size_t (*push_back)(cvector *this, void *ele);
+    void *(*at)(cvector *this, size_t n);
+    void **(*slot)(cvector *this, size_t n);
+    size_t (*next)(cvector *this, size_t n);
+    bool (*reserve)(cvector *this, size_t n);
+} cvector_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern cvector_operation cvop;
+
+/* Functions */
+void cvector_op_init(void);
+struct cvector_t *cvector_constructor(cvector *v, uint32_t tlen);
+void cvector_destructor(cvector *v);
+
+#endif
+/* EOF */
@@ -0,0 +1,416 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_deque.c
+*
+* DESCRIPTION:     Segmented double-ended queue built from fixed size blocks
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include "cstl_deque.h"
+//===========================
+// Defines
+//===========================
+#define BLOCK_BYTES             (CSTL_DEQUE_BLOCK * sizeof(void *))
+#define MAP_MIN                 8
+#define map_at(d, i)            ((d)->_map[((d)->_map_front + (i)) & ((d)->_map_capacity - 1)])
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+deque_operation dqop;
+
+/* Functions */
+static bool _empty_dq(deque *this);
+static size_t _size_dq(deque *this);
+static void *_at_dq(deque *this, size_t n);
+static void *_front_dq(deque *this);
+static void *_back_dq(deque *this);
+static bool _push_front_dq(deque *this, void *ele);
+static bool _push_back_dq(deque *this, void *ele);
+static void _pop_front_dq(deque *this);
+static void _pop_back_dq(deque *this);
+static void _clear_dq(deque *this);
+static void _shrink_to_fit_dq(deque *this);
+static void **_get_block_dq(deque *this);
+static void _put_block_dq(deque *this, void **block);
+static bool _resize_map_dq(deque *this, size_t capacity);
+
+//=============================================================================
+inline void
+deque_op_init(
+    void
+)
+//=============================================================================
+{
+    dqop.empty = _empty_dq;
+    dqop.size = _size_dq;
+    dqop.at = _at_dq;
+    dqop.front = _front_dq;
+    dqop.back = _back_dq;
+    dqop.push_front = _push_front_dq;
+    dqop.push_back = _push_back_dq;
+    dqop.pop_front = _pop_front_dq;
+    dqop.pop_back = _pop_back_dq;
+    dqop.clear = _clear_dq;
+    dqop.shrink_to_fit = _shrink_to_fit_dq;
+}
+
+//=============================================================================
+inline struct deque_t *
+deque_constructor(
+    deque *d,
+    uint32_t tlen
+)
+//=============================================================================
+{
+    return deque_constructor_alloc(d, tlen, &cstl_malloc_allocator);
+}
+
+/* alloc must stay valid until the deque is destructed */
+//=============================================================================
+inline struct deque_t *
+deque_constructor_alloc(
+    deque *d,
+    uint32_t tlen,
+    const cstl_allocator *alloc
+)
+//=============================================================================
+{
+    d->_deque = (struct deque_t *)alloc->alloc(alloc->ctx, sizeof(struct deque_t));
+    if (!d->_deque)
+        return NULL;
+
+    memset(d->_deque, 0, sizeof(struct deque_t));
+    d->_deque->_type_len = tlen;
+    d->_deque->_alloc = alloc;
+
+    debug(LOG_DEBUG, "deque constructor: d: %p, _d: %p", d, d->_deque);
+    return d->_deque;
+}
+
+//=============================================================================
+inline void
+deque_destructor(
+    deque *d
+)
+//=============================================================================
+{
+    const cstl_allocator *alloc;
+
+    if (!d->_deque)
+        return;
+
+    alloc = d->_deque->_alloc;
+    _clear_dq(d);
+    _shrink_to_fit_dq(d);
+    alloc->free(alloc->ctx, d->_deque, sizeof(struct deque_t));
+    d->_deque = NULL;
+}
+
+//=============================================================================
+static bool
+_empty_dq(
+    deque *this
+)
+//=============================================================================
+{
+    return this->_deque->_size ? false : true;
+}
+
+//=============================================================================
+static size_t
+_size_dq(
+    deque *this
+)
+//=============================================================================
+{
+    return this->_deque->_size;
+}
+
+/* Returns NULL when n is out of range. */
+//=============================================================================
+static void *
+_at_dq(
+    deque *this,
+    size_t n
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+
+    if (n >= d->_size)
+        return NULL;
+
+    n += d->_offset;
+    return map_at(d, n >> CSTL_DEQUE_SHIFT)[n & (CSTL_DEQUE_BLOCK - 1)];
+}
+
+//=============================================================================
+static void *
+_front_dq(
+    deque *this
+)
+//=============================================================================
+{
+    return _at_dq(this, 0);
+}
+
+//=============================================================================
+static void *
+_back_dq(
+    deque *this
+)
+//=============================================================================
+{
+    return this->_deque->_size ? _at_dq(this, this->_deque->_size - 1) : NULL;
+}
+
+//=============================================================================
+static bool
+_push_front_dq(
+    deque *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+    void **block;
+
+    if (d->_offset == 0) {
+        if (d->_blocks == d->_map_capacity && !_resize_map_dq(this, d->_map_capacity ? d->_map_capacity << 1 : MAP_MIN))
+            return false;
+        block = _get_block_dq(this);
+        if (!block)
+            return false;
+        d->_map_front = (d->_map_front - 1) & (d->_map_capacity - 1);
+        d->_map[d->_map_front] = block;
+        d->_blocks++;
+        d->_offset = CSTL_DEQUE_BLOCK;
+    }
+
+    d->_offset--;
+    map_at(d, 0)[d->_offset] = ele;
+    d->_size++;
+    return true;
+}
+
+//=============================================================================
+static bool
+_push_back_dq(
+    deque *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+    size_t end = d->_offset + d->_size;
+    void **block;
+
+    if (end == d->_blocks << CSTL_DEQUE_SHIFT) {
+        if (d->_blocks == d->_map_capacity && !_resize_map_dq(this, d->_map_capacity ? d->_map_capacity << 1 : MAP_MIN))
+            return false;
+        block = _get_block_dq(this);
+        if (!block)
+            return false;
+        map_at(d, d->_blocks) = block;
+        d->_blocks++;
+    }
+
+    map_at(d, end >> CSTL_DEQUE_SHIFT)[end & (CSTL_DEQUE_BLOCK - 1)] = ele;
+    d->_size++;
+    return true;
+}
+
+//=============================================================================
+static void
+_pop_front_dq(
+    deque *this
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+
+    if (!d->_size)
+        return;
+
+    d->_size--;
+    if (++d->_offset == CSTL_DEQUE_BLOCK || !d->_size) {
+        _put_block_dq(this, d->_map[d->_map_front]);
+        d->_map_front = (d->_map_front + 1) & (d->_map_capacity - 1);
+        d->_blocks--;
+        d->_offset = 0;
+        /* an emptied deque starts over, the block that held the last element may be the back one */
+        if (!d->_size)
+            _clear_dq(this);
+    }
+}
+
+//=============================================================================
+static void
+_pop_back_dq(
+    deque *this
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+
+    if (!d->_size)
+        return;
+
+    d->_size--;
+    if (d->_offset + d->_size <= (d->_blocks - 1) << CSTL_DEQUE_SHIFT) {
+        _put_block_dq(this, map_at(d, d->_blocks - 1));
+        d->_blocks--;
+    }
+    if (!d->_size)
+        _clear_dq(this);
+}
+
+/* Blocks go to the free list up to CSTL_DEQUE_FREE, the map is kept. */
+//=============================================================================
+static void
+_clear_dq(
+    deque *this
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+
+    while (d->_blocks) {
+        _put_block_dq(this, map_at(d, d->_blocks - 1));
+        d->_blocks--;
+    }
+    d->_size = 0;
+    d->_offset = 0;
+    d->_map_front = 0;
+}
+
+/* Releases the free list and fits the map to the blocks in use. */
+//=============================================================================
+static void
+_shrink_to_fit_dq(
+    deque *this
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+    const cstl_allocator *alloc = d->_alloc;
+    size_t capacity = MAP_MIN;
+    void **block;
+
+    while (d->_free) {
+        block = d->_free;
+        d->_free = (void **)block[0];
+        alloc->free(alloc->ctx, block, BLOCK_BYTES);
+    }
+    d->_free_size = 0;
+
+    if (!d->_blocks) {
+        if (d->_map)
+            alloc->free(alloc->ctx, d->_map, d->_map_capacity * sizeof(void **));
+        d->_map = NULL;
+        d->_map_capacity = 0;
+        d->_map_front = 0;
+        return;
+    }
+
+    while (capacity < d->_blocks)
+        capacity <<= 1;
+    if (capacity < d->_map_capacity)
+        _resize_map_dq(this, capacity);
+}
+
+//=============================================================================
+static void **
+_get_block_dq(
+    deque *this
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+    void **block = d->_free;
+
+    if (block) {
+        d->_free = (void **)block[0];
+        d->_free_size--;
+        return block;
+    }
+
+    return (void **)d->_alloc->alloc(d->_alloc->ctx, BLOCK_BYTES);
+}
+
+//=============================================================================
+static void
+_put_block_dq(
+    deque *this,
+    void **block
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+
+    if (d->_free_size == CSTL_DEQUE_FREE) {
+        d->_alloc->free(d->_alloc->ctx, block, BLOCK_BYTES);
+        return;
+    }
+
+    block[0] = d->_free;
+    d->_free = block;
+    d->_free_size++;
+}
+
+/* capacity is a power of two no smaller than _blocks, the blocks are unwrapped to the map start. */
+//=============================================================================
+static bool
+_resize_map_dq(
+    deque *this,
+    size_t capacity
+)
+//=============================================================================
+{
+    struct deque_t *d = this->_deque;
+    const cstl_allocator *alloc = d->_alloc;
+    void ***map;
+    size_t i;
+
+    map = (void ***)alloc->alloc(alloc->ctx, capacity * sizeof(void **));
+    if (!map)
+        return false;
+
+    for (i = 0; i < d->_blocks; i++)
+        map[i] = map_at(d, i);
+    if (d->_map)
+        alloc->free(alloc->ctx, d->_map, d->_map_capacity * sizeof(void **));
+
+    d->_map = map;
+    d->_map_capacity = capacity;
+    d->_map_front = 0;
+    return true;
+}
+
+/* EOF */
@@ -0,0 +1,95 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_deque.h
+*
+* DESCRIPTION:     Segmented double-ended queue built from fixed size blocks
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_DEQUE_H__
+#define __CSTL_DEQUE_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+/* elements per block, 1 << CSTL_DEQUE_SHIFT */
+#define CSTL_DEQUE_SHIFT        6
+#define CSTL_DEQUE_BLOCK        (1 << CSTL_DEQUE_SHIFT)
+/* emptied blocks kept for reuse, shrink_to_fit releases them */
+#define CSTL_DEQUE_FREE         8
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Elements live in fixed size blocks that are never moved once allocated. _map is a ring of
+ * block pointers, _map_front is the first block in use and _offset the slot of the first
+ * element in it. Growing at either end only adds a block, the map itself is reallocated when
+ * full but it holds one pointer per CSTL_DEQUE_BLOCK elements. Emptied blocks go onto _free,
+ * linked through their first slot.
+ */
+typedef struct {
+    struct deque_t {
+        size_t _size;
+        size_t _offset;
+        size_t _blocks;
+        size_t _map_front;
+        size_t _map_capacity;
+        void ***_map;
+        void **_free;
+        size_t _free_size;
+        uint32_t _type_len;
+        const cstl_allocator *_alloc;
+    } *_deque;
+} deque;
+
+typedef struct {
+    bool (*empty)(deque *this);
+    size_t (*size)(deque *this);
+    void *(*at)(deque *this, size_t n);
+    void *(*front)(deque *this);
+    void *(*back)(deque *this);
+    bool (*push_front)(deque *this, void *ele);
+    bool (*push_back)(deque *this, void *ele);
+    void (*pop_front)(deque *this);
+    void (*pop_back)(deque *this);
+    void (*clear)(deque *this);
+    void (*shrink_to_fit)(deque *this);
+} deque_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern deque_operation dqop;
+
+/* Functions */
+void deque_op_init(void);
+struct deque_t *deque_constructor(deque *d, uint32_t tlen);
+struct deque_t *deque_constructor_alloc(deque *d, uint32_t tlen, const cstl_allocator *alloc);
+void deque_destructor(deque *d);
+
+#endif
+/* EOF */
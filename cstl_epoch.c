@@ -0,0 +1,359 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_epoch.c
+*
+* DESCRIPTION:     Epoch based reclamation and a read copy update vector
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include "cstl_epoch.h"
+//===========================
+// Defines
+//===========================
+#define block_size(v)           vector_block_size((v)->_capacity * (v)->_type_len, (v)->_bitmap->_size)
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * One per thread that ever entered an epoch. _epoch is the global epoch the thread saw when
+ * it entered and 0 while it is outside. Records are linked once and never freed, the record
+ * of an exited thread is handed to the next new reader.
+ */
+struct epoch_reader_t {
+    _Alignas(CSTL_CACHELINE) atomic_ulong _epoch;
+    struct epoch_reader_t *_next;
+    atomic_bool _busy;
+};
+
+//===========================
+// Locals
+//===========================
+static atomic_ulong epoch = 1;
+static _Atomic(struct epoch_reader_t *) readers;
+static __thread struct epoch_reader_t *reader;
+static __thread uint32_t reader_nest;
+static pthread_key_t reader_key;
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+/* set once membarrier can stand in for the reader side fence */
+static atomic_bool expedited;
+
+static struct epoch_reader_t *_claim_reader(void);
+static void _release_reader(void *r);
+static void _epoch_init(void);
+static struct vector_t *_clone_rv(const struct vector_t *src);
+static void _free_rv(struct vector_t *v);
+
+//===========================
+// Globals
+//===========================
+
+/*
+ * Readers nest, only the outermost enter and leave count. The reader side is a store and a
+ * fence. Once membarrier is registered the fence only has to stop the compiler, the writer
+ * makes every running thread execute a full barrier for it in cstl_epoch_synchronize.
+ */
+//=============================================================================
+inline void
+cstl_epoch_enter(
+    void
+)
+//=============================================================================
+{
+    struct epoch_reader_t *r = reader ? reader : _claim_reader();
+
+    if (reader_nest++)
+        return;
+
+    /* acquire pairs with the writer's epoch bump, which comes after its pointer store */
+    atomic_store_explicit(&r->_epoch, atomic_load_explicit(&epoch, memory_order_acquire), memory_order_relaxed);
+    if (atomic_load_explicit(&expedited, memory_order_relaxed))
+        atomic_signal_fence(memory_order_seq_cst);
+    else
+        atomic_thread_fence(memory_order_seq_cst);
+}
+
+//=============================================================================
+inline void
+cstl_epoch_leave(
+    void
+)
+//=============================================================================
+{
+    if (--reader_nest)
+        return;
+
+    atomic_store_explicit(&reader->_epoch, 0, memory_order_release);
+}
+
+/*
+ * Wait until every reader that entered before the call has left, anything unpublished
+ * before the call may be freed afterwards. Must not be called from inside an epoch.
+ */
+//=============================================================================
+inline void
+cstl_epoch_synchronize(
+    void
+)
+//=============================================================================
+{
+    struct epoch_reader_t *r;
+    unsigned long target;
+    unsigned long e;
+
+    pthread_once(&reader_once, _epoch_init);
+    target = atomic_fetch_add_explicit(&epoch, 1, memory_order_seq_cst) + 1;
+    if (!atomic_load_explicit(&expedited, memory_order_relaxed) ||
+            syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) < 0)
+        atomic_thread_fence(memory_order_seq_cst);
+
+    for (r = atomic_load_explicit(&readers, memory_order_acquire); r; r = r->_next) {
+        while ((e = atomic_load_explicit(&r->_epoch, memory_order_acquire)) && e < target)
+            sched_yield();
+    }
+}
+
+//=============================================================================
+inline struct rcu_vector_t *
+rcu_vector_constructor(
+    rcu_vector *r,
+    uint32_t tlen
+)
+//=============================================================================
+{
+    return rcu_vector_constructor_alloc(r, tlen, &cstl_malloc_allocator);
+}
+
+/* alloc must stay valid until the vector is destructed, it is only used by writers */
+//=============================================================================
+inline struct rcu_vector_t *
+rcu_vector_constructor_alloc(
+    rcu_vector *r,
+    uint32_t tlen,
+    const cstl_allocator *alloc
+)
+//=============================================================================
+{
+    struct vector_t *v;
+    vector tmp;
+
+    r->_rcu = (struct rcu_vector_t *)calloc(1, sizeof(struct rcu_vector_t));
+    if (!r->_rcu)
+        return NULL;
+
+    /* an empty vector built the usual way, copied out of the handle that may hold it inline */
+    v = vector_constructor_alloc(&tmp, tlen, alloc) ? _clone_rv(tmp._vector) : NULL;
+    vector_destructor(&tmp);
+    if (!v) {
+        free(r->_rcu);
+        r->_rcu = NULL;
+        return NULL;
+    }
+
+    atomic_init(&r->_rcu->_current, v);
+    pthread_mutex_init(&r->_rcu->_lock, NULL);
+    pthread_once(&reader_once, _epoch_init);
+
+    debug(LOG_DEBUG, "rcu vector constructor: r: %p, _r: %p, _v: %p", r, r->_rcu, v);
+    return r->_rcu;
+}
+
+/* no reader or writer may still be using the vector */
+//=============================================================================
+inline void
+rcu_vector_destructor(
+    rcu_vector *r
+)
+//=============================================================================
+{
+    if (!r->_rcu)
+        return;
+
+    _free_rv(atomic_load_explicit(&r->_rcu->_current, memory_order_relaxed));
+    pthread_mutex_destroy(&r->_rcu->_lock);
+    free(r->_rcu);
+    r->_rcu = NULL;
+}
+
+/*
+ * Point snap at the current version, only valid until the cstl_epoch_leave matching the
+ * enter this is called under. snap must only be read.
+ */
+//=============================================================================
+inline vector *
+rcu_vector_read(
+    rcu_vector *r,
+    vector *snap
+)
+//=============================================================================
+{
+    snap->_vector = atomic_load_explicit(&r->_rcu->_current, memory_order_acquire);
+    return snap;
+}
+
+/* Take the writer lock and give w a private copy, NULL with the lock released if the copy fails. */
+//=============================================================================
+inline vector *
+rcu_vector_write_begin(
+    rcu_vector *r,
+    vector *w
+)
+//=============================================================================
+{
+    pthread_mutex_lock(&r->_rcu->_lock);
+    w->_vector = _clone_rv(atomic_load_explicit(&r->_rcu->_current, memory_order_relaxed));
+    if (!w->_vector) {
+        pthread_mutex_unlock(&r->_rcu->_lock);
+        return NULL;
+    }
+
+    return w;
+}
+
+/* publish w, then wait for the readers of the old version before freeing it */
+//=============================================================================
+inline void
+rcu_vector_write_end(
+    rcu_vector *r,
+    vector *w
+)
+//=============================================================================
+{
+    struct vector_t *old = atomic_load_explicit(&r->_rcu->_current, memory_order_relaxed);
+
+    atomic_store_explicit(&r->_rcu->_current, w->_vector, memory_order_release);
+    pthread_mutex_unlock(&r->_rcu->_lock);
+    w->_vector = NULL;
+
+    cstl_epoch_synchronize();
+    _free_rv(old);
+}
+
+//=============================================================================
+inline void
+rcu_vector_write_abort(
+    rcu_vector *r,
+    vector *w
+)
+//=============================================================================
+{
+    _free_rv(w->_vector);
+    w->_vector = NULL;
+    pthread_mutex_unlock(&r->_rcu->_lock);
+}
+
+/* First epoch of this thread, reuse the record of an exited thread or link a new one. */
+//=============================================================================
+static struct epoch_reader_t *
+_claim_reader(
+    void
+)
+//=============================================================================
+{
+    struct epoch_reader_t *r;
+    bool busy;
+
+    pthread_once(&reader_once, _epoch_init);
+
+    for (r = atomic_load_explicit(&readers, memory_order_acquire); r; r = r->_next) {
+        busy = false;
+        if (atomic_compare_exchange_strong(&r->_busy, &busy, true))
+            break;
+    }
+
+    if (!r) {
+        /* nothing to fall back on, a reader that can't be tracked can't be let in */
+        r = (struct epoch_reader_t *)aligned_alloc(CSTL_CACHELINE, sizeof(struct epoch_reader_t));
+        if (!r)
+            abort();
+        atomic_init(&r->_epoch, 0);
+        atomic_init(&r->_busy, true);
+        r->_next = atomic_load_explicit(&readers, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&readers, &r->_next, r, memory_order_release, memory_order_relaxed))
+            ;
+    }
+
+    reader = r;
+    pthread_setspecific(reader_key, r);
+    return r;
+}
+
+//=============================================================================
+static void
+_release_reader(
+    void *r
+)
+//=============================================================================
+{
+    atomic_store_explicit(&((struct epoch_reader_t *)r)->_epoch, 0, memory_order_relaxed);
+    atomic_store_explicit(&((struct epoch_reader_t *)r)->_busy, false, memory_order_release);
+}
+
+//=============================================================================
+static void
+_epoch_init(
+    void
+)
+//=============================================================================
+{
+    pthread_key_create(&reader_key, _release_reader);
+    if (syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+        atomic_store_explicit(&expedited, true, memory_order_relaxed);
+}
+
+/* header, elements and bitmap are one block, inline or not, so one copy takes all of it */
+//=============================================================================
+static struct vector_t *
+_clone_rv(
+    const struct vector_t *src
+)
+//=============================================================================
+{
+    const cstl_allocator *alloc = src->_alloc;
+    struct vector_t *v = (struct vector_t *)alloc->alloc(alloc->ctx, block_size(src));
+
+    if (!v)
+        return NULL;
+
+    memcpy(v, src, block_size(src));
+    v->_flags &= ~CSTL_INLINE_STORAGE;
+#if CSTL_STATS
+    /* the copies aren't registered, the record belongs to src */
+    v->_stats = NULL;
+#endif
+    v->_bitmap = (struct bitmap_t *)((uint8_t *)v + vector_bitmap_offset(v->_capacity * v->_type_len));
+    return v;
+}
+
+//=============================================================================
+static void
+_free_rv(
+    struct vector_t *v
+)
+//=============================================================================
+{
+    if (v)
+        v->_alloc->free(v->_alloc->ctx, v, block_size(v));
+}
+
+/* EOF */
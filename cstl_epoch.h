@@ -0,0 +1,76 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_epoch.h
+*
+* DESCRIPTION:     Epoch based reclamation and a read copy update vector
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_EPOCH_H__
+#define __CSTL_EPOCH_H__
+
+//===========================
+// Includes
+//===========================
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Vector read without a lock. Readers take a snapshot inside cstl_epoch_enter/leave and use
+ * it with the read only vop functions (size, at, front, back, vector_for_each_element).
+ * A writer takes the writer lock, changes a private copy of the whole vector with the usual
+ * vop functions and publishes it with one pointer store. The old copy is freed once every
+ * reader that could still see it has left its epoch. Meant for data that is read all the
+ * time and changed rarely, every write copies the vector.
+ */
+typedef struct {
+    struct rcu_vector_t {
+        _Atomic(struct vector_t *) _current;
+        pthread_mutex_t _lock;
+    } *_rcu;
+} rcu_vector;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+void cstl_epoch_enter(void);
+void cstl_epoch_leave(void);
+void cstl_epoch_synchronize(void);
+
+struct rcu_vector_t *rcu_vector_constructor(rcu_vector *r, uint32_t tlen);
+struct rcu_vector_t *rcu_vector_constructor_alloc(rcu_vector *r, uint32_t tlen, const cstl_allocator *alloc);
+void rcu_vector_destructor(rcu_vector *r);
+vector *rcu_vector_read(rcu_vector *r, vector *snap);
+vector *rcu_vector_write_begin(rcu_vector *r, vector *w);
+void rcu_vector_write_end(rcu_vector *r, vector *w);
+void rcu_vector_write_abort(rcu_vector *r, vector *w);
+
+#endif
+/* EOF */
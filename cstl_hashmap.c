@@ -0,0 +1,608 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_hashmap.c
+*
+* DESCRIPTION:     Open addressing hash map with 16 wide probed control bytes
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include "cstl_hashmap.h"
+//===========================
+// Defines
+//===========================
+#define CTRL_EMPTY              ((int8_t)-128)
+#define CTRL_DELETED            ((int8_t)-2)
+#define MIN_CAPACITY            CSTL_HASHMAP_GROUP
+#define MIX                     0x9e3779b97f4a7c15ULL
+
+#define h1(hash)                ((hash) >> 7)
+#define h2(hash)                ((int8_t)((hash) & 0x7f))
+#define max_load(cap)           ((cap) - (cap) / 8)
+#define slot_at(m, i)           ((m)->_slots + (size_t)(i) * (m)->_slot_len)
+#define slot_value(m, i)        (*(void **)slot_at(m, i))
+#define slot_key(m, i)          ((m)->_key_len ? (const void *)(slot_at(m, i) + sizeof(void *)) : *(void **)(slot_at(m, i) + sizeof(void *)))
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+hashmap_operation hop;
+
+/* Functions */
+static bool _empty_hm(hashmap *this);
+static size_t _size_hm(hashmap *this);
+static bool _insert_hm(hashmap *this, const void *key, void *value);
+static void **_find_hm(hashmap *this, const void *key);
+static bool _erase_hm(hashmap *this, const void *key);
+static bool _reserve_hm(hashmap *this, size_t n);
+static void _rehash_hm(hashmap *this);
+static void _clear_hm(hashmap *this);
+static bool _next_hm(hashmap *this, size_t *it, const void **key, void **value);
+static bool _set_hash_hm(hashmap *this, hashmap_hash hash, hashmap_equal equal);
+static bool _equal_bytes(const void *a, const void *b, size_t len);
+static bool _equal_ptr(const void *a, const void *b, size_t len);
+static size_t _lookup_hm(struct hashmap_t *m, const void *key, uint64_t hash);
+static size_t _find_free_hm(struct hashmap_t *m, uint64_t hash);
+static bool _resize_hm(struct hashmap_t *m, size_t capacity);
+
+/* bit i set when control byte i of the group equals c */
+static inline uint32_t _group_match(const int8_t *g, int8_t c)
+{
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)g), _mm_set1_epi8(c)));
+#else
+    uint32_t bits = 0;
+    int i;
+
+    for (i = 0; i < CSTL_HASHMAP_GROUP; i++)
+        bits |= (uint32_t)(g[i] == c) << i;
+    return bits;
+#endif
+}
+
+/* bit i set when control byte i is empty or deleted, both have the sign bit set */
+static inline uint32_t _group_free(const int8_t *g)
+{
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+    uint32_t bits = 0;
+    int i;
+
+    for (i = 0; i < CSTL_HASHMAP_GROUP; i++)
+        bits |= (uint32_t)(g[i] < 0) << i;
+    return bits;
+#endif
+}
+
+static inline uint64_t _fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+//=============================================================================
+inline void
+hashmap_op_init(
+    void
+)
+//=============================================================================
+{
+    hop.empty = _empty_hm;
+    hop.size = _size_hm;
+    hop.insert = _insert_hm;
+    hop.find = _find_hm;
+    hop.erase = _erase_hm;
+    hop.reserve = _reserve_hm;
+    hop.rehash = _rehash_hm;
+    hop.clear = _clear_hm;
+    hop.next = _next_hm;
+    hop.set_hash = _set_hash_hm;
+}
+
+/* klen 0 keys the map by pointer value, otherwise by klen bytes pointed to by key */
+//=============================================================================
+inline struct hashmap_t *
+hashmap_constructor(
+    hashmap *m,
+    uint32_t klen
+)
+//=============================================================================
+{
+    return hashmap_constructor_alloc(m, klen, &cstl_malloc_allocator);
+}
+
+/* alloc must stay valid until the map is destructed */
+//=============================================================================
+inline struct hashmap_t *
+hashmap_constructor_alloc(
+    hashmap *m,
+    uint32_t klen,
+    const cstl_allocator *alloc
+)
+//=============================================================================
+{
+    m->_hashmap = (struct hashmap_t *)alloc->alloc(alloc->ctx, sizeof(struct hashmap_t));
+    if (!m->_hashmap)
+        return NULL;
+
+    memset(m->_hashmap, 0, sizeof(struct hashmap_t));
+    m->_hashmap->_key_len = klen;
+    m->_hashmap->_slot_len = sizeof(void *) + (klen ? (klen + sizeof(void *) - 1) & ~(sizeof(void *) - 1) : sizeof(void *));
+    m->_hashmap->_hash = klen ? hashmap_hash_bytes : hashmap_hash_ptr;
+    m->_hashmap->_equal = klen ? _equal_bytes : _equal_ptr;
+    m->_hashmap->_alloc = alloc;
+
+    debug(LOG_DEBUG, "hashmap constructor: m: %p, _m: %p, klen: %lu", m, m->_hashmap, klen);
+    return m->_hashmap;
+}
+
+//=============================================================================
+inline void
+hashmap_destructor(
+    hashmap *m
+)
+//=============================================================================
+{
+    struct hashmap_t *map = m->_hashmap;
+    const cstl_allocator *alloc;
+
+    if (!map)
+        return;
+
+    alloc = map->_alloc;
+    if (map->_ctrl)
+        alloc->free(alloc->ctx, map->_ctrl, map->_capacity * (1 + map->_slot_len));
+    alloc->free(alloc->ctx, map, sizeof(struct hashmap_t));
+    m->_hashmap = NULL;
+}
+
+/* Default hash of klen byte keys. */
+//=============================================================================
+inline uint64_t
+hashmap_hash_bytes(
+    const void *key,
+    size_t len
+)
+//=============================================================================
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = len * MIX;
+    uint64_t w;
+
+    for (; len >= sizeof(w); len -= sizeof(w), p += sizeof(w)) {
+        memcpy(&w, p, sizeof(w));
+        h = (h ^ _fmix64(w)) * MIX;
+    }
+    if (len) {
+        w = 0;
+        memcpy(&w, p, len);
+        h ^= _fmix64(w ^ len);
+    }
+
+    return _fmix64(h);
+}
+
+/* Default hash of pointer keys, the address itself. */
+//=============================================================================
+inline uint64_t
+hashmap_hash_ptr(
+    const void *key,
+    size_t len
+)
+//=============================================================================
+{
+    return _fmix64((uint64_t)(uintptr_t)key);
+}
+
+//=============================================================================
+static bool
+_empty_hm(
+    hashmap *this
+)
+//=============================================================================
+{
+    return this->_hashmap->_size ? false : true;
+}
+
+//=============================================================================
+static size_t
+_size_hm(
+    hashmap *this
+)
+//=============================================================================
+{
+    return this->_hashmap->_size;
+}
+
+/* Inserts key or replaces the value stored for it, returns false if the map couldn't grow. */
+//=============================================================================
+static bool
+_insert_hm(
+    hashmap *this,
+    const void *key,
+    void *value
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+    uint64_t hash = m->_hash(key, m->_key_len);
+    size_t i = _lookup_hm(m, key, hash);
+
+    if (i != (size_t)-1) {
+        slot_value(m, i) = value;
+        return true;
+    }
+
+    if (!m->_growth_left) {
+        /* mostly tombstones, dropping them frees enough room without growing */
+        if (m->_capacity && m->_size <= max_load(m->_capacity) / 2)
+            _rehash_hm(this);
+        else if (!_resize_hm(m, m->_capacity ? m->_capacity << 1 : MIN_CAPACITY))
+            return false;
+    }
+
+    i = _find_free_hm(m, hash);
+    if (m->_ctrl[i] == CTRL_EMPTY)
+        m->_growth_left--;
+    m->_ctrl[i] = h2(hash);
+    slot_value(m, i) = value;
+    if (m->_key_len)
+        memcpy(slot_at(m, i) + sizeof(void *), key, m->_key_len);
+    else
+        *(const void **)(slot_at(m, i) + sizeof(void *)) = key;
+    m->_size++;
+    return true;
+}
+
+/* Returns where the value of key is stored, or NULL if key isn't in the map. */
+//=============================================================================
+static void **
+_find_hm(
+    hashmap *this,
+    const void *key
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+    size_t i;
+
+    if (!m->_size)
+        return NULL;
+
+    i = _lookup_hm(m, key, m->_hash(key, m->_key_len));
+    return i == (size_t)-1 ? NULL : &slot_value(m, i);
+}
+
+/*
+ * A probe only stops in a group that has an empty byte, so when the group of the erased
+ * slot still has one no probe ever went past it and the slot can be empty again, otherwise
+ * it becomes a tombstone.
+ */
+//=============================================================================
+static bool
+_erase_hm(
+    hashmap *this,
+    const void *key
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+    size_t i;
+
+    if (!m->_size)
+        return false;
+
+    i = _lookup_hm(m, key, m->_hash(key, m->_key_len));
+    if (i == (size_t)-1)
+        return false;
+
+    if (_group_match(m->_ctrl + (i & ~(size_t)(CSTL_HASHMAP_GROUP - 1)), CTRL_EMPTY)) {
+        m->_ctrl[i] = CTRL_EMPTY;
+        m->_growth_left++;
+    }
+    else {
+        m->_ctrl[i] = CTRL_DELETED;
+    }
+    m->_size--;
+    return true;
+}
+
+/* Makes room for n keys in total without further growth. */
+//=============================================================================
+static bool
+_reserve_hm(
+    hashmap *this,
+    size_t n
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+    size_t capacity = MIN_CAPACITY;
+
+    while (max_load(capacity) < n)
+        capacity <<= 1;
+
+    if (capacity <= m->_capacity)
+        return true;
+
+    return _resize_hm(m, capacity);
+}
+
+/*
+ * Drops every tombstone in place, no allocation. Live slots are first marked deleted and
+ * empty ones stay empty, then each marked key goes to the first free slot of its probe. A
+ * key whose probe reaches its own group first stays put, one landing on an empty slot moves
+ * there, one landing on a still marked slot swaps with it and the swapped in key is placed
+ * next.
+ */
+//=============================================================================
+static void
+_rehash_hm(
+    hashmap *this
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+    size_t i, j, k;
+    uint64_t hash;
+    uint8_t *a, *b, t;
+
+    for (i = 0; i < m->_capacity; i++)
+        m->_ctrl[i] = m->_ctrl[i] == CTRL_DELETED ? CTRL_EMPTY : m->_ctrl[i] >= 0 ? CTRL_DELETED : m->_ctrl[i];
+
+    for (i = 0; i < m->_capacity; i++) {
+        if (m->_ctrl[i] != CTRL_DELETED)
+            continue;
+
+        hash = m->_hash(slot_key(m, i), m->_key_len);
+        j = _find_free_hm(m, hash);
+
+        /* no free slot comes earlier on the probe than the group of i, lookups find it there */
+        if (j / CSTL_HASHMAP_GROUP == i / CSTL_HASHMAP_GROUP) {
+            m->_ctrl[i] = h2(hash);
+            continue;
+        }
+
+        if (m->_ctrl[j] == CTRL_EMPTY) {
+            memcpy(slot_at(m, j), slot_at(m, i), m->_slot_len);
+            m->_ctrl[j] = h2(hash);
+            m->_ctrl[i] = CTRL_EMPTY;
+            continue;
+        }
+
+        a = slot_at(m, i);
+        b = slot_at(m, j);
+        for (k = 0; k < m->_slot_len; k++) {
+            t = a[k];
+            a[k] = b[k];
+            b[k] = t;
+        }
+        m->_ctrl[j] = h2(hash);
+        i--;
+    }
+
+    m->_growth_left = max_load(m->_capacity) - m->_size;
+}
+
+/* Keeps the table, every key is dropped. */
+//=============================================================================
+static void
+_clear_hm(
+    hashmap *this
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+
+    if (m->_ctrl)
+        memset(m->_ctrl, (uint8_t)CTRL_EMPTY, m->_capacity);
+    m->_size = 0;
+    m->_growth_left = max_load(m->_capacity);
+}
+
+/*
+ * Iterates in table order, start with *it = 0. key gets the pointer key or points at the
+ * stored bytes. Inserting during the walk may rehash, erasing the current key is fine.
+ */
+//=============================================================================
+static bool
+_next_hm(
+    hashmap *this,
+    size_t *it,
+    const void **key,
+    void **value
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+    size_t i;
+
+    for (i = *it; i < m->_capacity; i++) {
+        if (m->_ctrl[i] >= 0) {
+            if (key)
+                *key = slot_key(m, i);
+            if (value)
+                *value = slot_value(m, i);
+            *it = i + 1;
+            return true;
+        }
+    }
+
+    *it = i;
+    return false;
+}
+
+/* Only while the map is empty, NULL keeps the default. */
+//=============================================================================
+static bool
+_set_hash_hm(
+    hashmap *this,
+    hashmap_hash hash,
+    hashmap_equal equal
+)
+//=============================================================================
+{
+    struct hashmap_t *m = this->_hashmap;
+
+    if (m->_size)
+        return false;
+
+    if (hash)
+        m->_hash = hash;
+    if (equal)
+        m->_equal = equal;
+    return true;
+}
+
+//=============================================================================
+static bool
+_equal_bytes(
+    const void *a,
+    const void *b,
+    size_t len
+)
+//=============================================================================
+{
+    return memcmp(a, b, len) == 0;
+}
+
+//=============================================================================
+static bool
+_equal_ptr(
+    const void *a,
+    const void *b,
+    size_t len
+)
+//=============================================================================
+{
+    return a == b;
+}
+
+/* Returns the slot holding key, or (size_t)-1. */
+//=============================================================================
+static size_t
+_lookup_hm(
+    struct hashmap_t *m,
+    const void *key,
+    uint64_t hash
+)
+//=============================================================================
+{
+    size_t gmask, g, step, i;
+    const int8_t *ctrl;
+    uint32_t bits;
+
+    if (!m->_capacity)
+        return (size_t)-1;
+
+    gmask = m->_capacity / CSTL_HASHMAP_GROUP - 1;
+    g = h1(hash) & gmask;
+    for (step = 0; step <= gmask; g = (g + ++step) & gmask) {
+        ctrl = m->_ctrl + g * CSTL_HASHMAP_GROUP;
+        for (bits = _group_match(ctrl, h2(hash)); bits; bits &= bits - 1) {
+            i = g * CSTL_HASHMAP_GROUP + __builtin_ctz(bits);
+            if (m->_equal(slot_key(m, i), key, m->_key_len))
+                return i;
+        }
+        if (_group_match(ctrl, CTRL_EMPTY))
+            break;
+    }
+
+    return (size_t)-1;
+}
+
+/* First empty or deleted slot on the probe of hash, there always is one below 7/8 load. */
+//=============================================================================
+static size_t
+_find_free_hm(
+    struct hashmap_t *m,
+    uint64_t hash
+)
+//=============================================================================
+{
+    size_t gmask = m->_capacity / CSTL_HASHMAP_GROUP - 1;
+    size_t g = h1(hash) & gmask;
+    size_t step = 0;
+    uint32_t bits;
+
+    while (!(bits = _group_free(m->_ctrl + g * CSTL_HASHMAP_GROUP)))
+        g = (g + ++step) & gmask;
+
+    return g * CSTL_HASHMAP_GROUP + __builtin_ctz(bits);
+}
+
+/* Moves every key into a new table of capacity slots, tombstones are left behind. */
+//=============================================================================
+static bool
+_resize_hm(
+    struct hashmap_t *m,
+    size_t capacity
+)
+//=============================================================================
+{
+    const cstl_allocator *alloc = m->_alloc;
+    int8_t *ctrl = m->_ctrl;
+    uint8_t *slots = m->_slots;
+    size_t old = m->_capacity;
+    uint8_t *src;
+    uint64_t hash;
+    size_t i, j;
+
+    m->_ctrl = (int8_t *)alloc->alloc(alloc->ctx, capacity * (1 + m->_slot_len));
+    if (!m->_ctrl) {
+        m->_ctrl = ctrl;
+        return false;
+    }
+
+    m->_slots = (uint8_t *)m->_ctrl + capacity;
+    m->_capacity = capacity;
+    memset(m->_ctrl, (uint8_t)CTRL_EMPTY, capacity);
+
+    for (i = 0; i < old; i++) {
+        if (ctrl[i] < 0)
+            continue;
+        src = slots + i * m->_slot_len;
+        hash = m->_hash(m->_key_len ? (const void *)(src + sizeof(void *)) : *(void **)(src + sizeof(void *)), m->_key_len);
+        j = _find_free_hm(m, hash);
+        m->_ctrl[j] = h2(hash);
+        memcpy(slot_at(m, j), src, m->_slot_len);
+    }
+    m->_growth_left = max_load(capacity) - m->_size;
+
+    if (ctrl)
+        alloc->free(alloc->ctx, ctrl, old * (1 + m->_slot_len));
+
+    debug(LOG_DEBUG, "hashmap resize: m: %p, capa: %lu -> %lu, size: %lu", m, old, capacity, m->_size);
+    return true;
+}
+
+/* EOF */
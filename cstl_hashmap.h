@@ -0,0 +1,100 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_hashmap.h
+*
+* DESCRIPTION:     Open addressing hash map with 16 wide probed control bytes
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_HASHMAP_H__
+#define __CSTL_HASHMAP_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+/* control bytes per probed group */
+#define CSTL_HASHMAP_GROUP      16
+
+//===========================
+// Typedefs
+//===========================
+/* key is what was passed to insert/find, len is _key_len (0 for pointer keys) */
+typedef uint64_t (*hashmap_hash)(const void *key, size_t len);
+typedef bool (*hashmap_equal)(const void *a, const void *b, size_t len);
+
+/*
+ * Open addressing in the SwissTable manner. Every slot has a control byte, empty, deleted
+ * or the low 7 bits of the key hash, and lookups compare a group of 16 control bytes at
+ * once before touching any key. Groups are probed triangularly starting at the group
+ * picked by the upper hash bits, a probe ends at the first group with an empty byte.
+ *
+ * With _key_len 0 the keys are the pointers themselves, otherwise a key is _key_len bytes
+ * copied into the map. Values are void *. _ctrl and _slots share one allocation.
+ */
+typedef struct {
+    struct hashmap_t {
+        size_t _size;
+        size_t _capacity;
+        /* inserts left before the table is full up to 7/8, tombstones count as used */
+        size_t _growth_left;
+        uint32_t _key_len;
+        uint32_t _slot_len;
+        hashmap_hash _hash;
+        hashmap_equal _equal;
+        const cstl_allocator *_alloc;
+        int8_t *_ctrl;
+        uint8_t *_slots;
+    } *_hashmap;
+} hashmap;
+
+typedef struct {
+    bool (*empty)(hashmap *this);
+    size_t (*size)(hashmap *this);
+    bool (*insert)(hashmap *this, const void *key, void *value);
+    void **(*find)(hashmap *this, const void *key);
+    bool (*erase)(hashmap *this, const void *key);
+    bool (*reserve)(hashmap *this, size_t n);
+    void (*rehash)(hashmap *this);
+    void (*clear)(hashmap *this);
+    bool (*next)(hashmap *this, size_t *it, const void **key, void **value);
+    bool (*set_hash)(hashmap *this, hashmap_hash hash, hashmap_equal equal);
+} hashmap_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern hashmap_operation hop;
+
+/* Functions */
+void hashmap_op_init(void);
+struct hashmap_t *hashmap_constructor(hashmap *m, uint32_t klen);
+struct hashmap_t *hashmap_constructor_alloc(hashmap *m, uint32_t klen, const cstl_allocator *alloc);
+void hashmap_destructor(hashmap *m);
+uint64_t hashmap_hash_bytes(const void *key, size_t len);
+uint64_t hashmap_hash_ptr(const void *key, size_t len);
+
+#endif
+/* EOF */
@@ -0,0 +1,439 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_heap.c
+*
+* DESCRIPTION:     d-ary heap priority queue on vector storage
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include "cstl_heap.h"
+//===========================
+// Defines
+//===========================
+#define slots(h)                ((h)->_vector._vector->_vector)
+#define count(h)                ((h)->_vector._vector->_size)
+#define parent(h, i)            (((i) - 1) >> (h)->_shift)
+#define child(h, i)             (((i) << (h)->_shift) + 1)
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+heap_operation hpop;
+
+/* Functions */
+static bool _empty_hp(heap *this);
+static size_t _size_hp(heap *this);
+static void *_top_hp(heap *this);
+static bool _push_hp(heap *this, void *ele);
+static void *_pop_hp(heap *this);
+static void _update_hp(heap *this, size_t pos);
+static void *_erase_hp(heap *this, size_t pos);
+static bool _heapify_hp(heap *this, vector *src);
+static void _clear_hp(heap *this);
+static void _set_moved_hp(heap *this, heap_moved moved, void *ctx);
+static bool _sift_up_hp(struct heap_t *h, size_t pos);
+static void _sift_down_hp(struct heap_t *h, size_t pos);
+static struct heap_t *_construct_hp(heap *h, uint32_t tlen, uint32_t arity);
+
+//=============================================================================
+inline void
+heap_op_init(
+    void
+)
+//=============================================================================
+{
+    vector_op_init();
+
+    hpop.empty = _empty_hp;
+    hpop.size = _size_hp;
+    hpop.top = _top_hp;
+    hpop.push = _push_hp;
+    hpop.pop = _pop_hp;
+    hpop.update = _update_hp;
+    hpop.erase = _erase_hp;
+    hpop.heapify = _heapify_hp;
+    hpop.clear = _clear_hp;
+    hpop.set_moved = _set_moved_hp;
+}
+
+/* arity must be 2, 4 or 8, cmp orders the elements */
+//=============================================================================
+inline struct heap_t *
+heap_constructor(
+    heap *h,
+    uint32_t tlen,
+    uint32_t arity,
+    heap_compare cmp,
+    void *ctx
+)
+//=============================================================================
+{
+    if (!cmp || !_construct_hp(h, tlen, arity))
+        return NULL;
+
+    h->_heap->_cmp = cmp;
+    h->_heap->_ctx = ctx;
+    return h->_heap;
+}
+
+/* arity must be 2, 4 or 8, elements come out by ascending key */
+//=============================================================================
+inline struct heap_t *
+heap_constructor_key(
+    heap *h,
+    uint32_t tlen,
+    uint32_t arity,
+    heap_key key
+)
+//=============================================================================
+{
+    if (!key || !_construct_hp(h, tlen, arity))
+        return NULL;
+
+    h->_heap->_key = key;
+    return h->_heap;
+}
+
+//=============================================================================
+inline void
+heap_destructor(
+    heap *h
+)
+//=============================================================================
+{
+    if (!h->_heap)
+        return;
+
+    vector_destructor(&h->_heap->_vector);
+    free(h->_heap);
+    h->_heap = NULL;
+}
+
+//=============================================================================
+static struct heap_t *
+_construct_hp(
+    heap *h,
+    uint32_t tlen,
+    uint32_t arity
+)
+//=============================================================================
+{
+    h->_heap = NULL;
+    if (arity != 2 && arity != 4 && arity != 8)
+        return NULL;
+
+    h->_heap = (struct heap_t *)calloc(1, sizeof(struct heap_t));
+    if (!h->_heap)
+        return NULL;
+
+    if (!vector_constructor(&h->_heap->_vector, tlen)) {
+        free(h->_heap);
+        h->_heap = NULL;
+        return NULL;
+    }
+    h->_heap->_shift = __builtin_ctz(arity);
+
+    debug(LOG_DEBUG, "heap constructor: h: %p, _h: %p, arity: %lu", h, h->_heap, arity);
+    return h->_heap;
+}
+
+//=============================================================================
+static bool
+_empty_hp(
+    heap *this
+)
+//=============================================================================
+{
+    return count(this->_heap) ? false : true;
+}
+
+//=============================================================================
+static size_t
+_size_hp(
+    heap *this
+)
+//=============================================================================
+{
+    return count(this->_heap);
+}
+
+//=============================================================================
+static void *
+_top_hp(
+    heap *this
+)
+//=============================================================================
+{
+    return count(this->_heap) ? slots(this->_heap)[0] : NULL;
+}
+
+//=============================================================================
+static bool
+_push_hp(
+    heap *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct heap_t *h = this->_heap;
+
+    if (!vop.push_back(&h->_vector, ele))
+        return false;
+
+    if (!_sift_up_hp(h, count(h) - 1) && h->_moved)
+        h->_moved(h->_moved_ctx, ele, count(h) - 1);
+    return true;
+}
+
+/* Removes and returns the top, NULL when empty. */
+//=============================================================================
+static void *
+_pop_hp(
+    heap *this
+)
+//=============================================================================
+{
+    return count(this->_heap) ? _erase_hp(this, 0) : NULL;
+}
+
+/* The priority of the element at pos changed in either direction, restore the order. */
+//=============================================================================
+static void
+_update_hp(
+    heap *this,
+    size_t pos
+)
+//=============================================================================
+{
+    struct heap_t *h = this->_heap;
+
+    if (pos >= count(h))
+        return;
+
+    if (!_sift_up_hp(h, pos))
+        _sift_down_hp(h, pos);
+}
+
+/* Removes and returns the element at pos, NULL when pos is out of range. */
+//=============================================================================
+static void *
+_erase_hp(
+    heap *this,
+    size_t pos
+)
+//=============================================================================
+{
+    struct heap_t *h = this->_heap;
+    size_t last = count(h) - 1;
+    void *ele;
+
+    if (pos > last || !count(h))
+        return NULL;
+
+    ele = slots(h)[pos];
+    slots(h)[pos] = slots(h)[last];
+    vop.pop_back(&h->_vector);
+    if (pos < last)
+        _update_hp(this, pos);
+
+    return ele;
+}
+
+/*
+ * Adds every live element of src and rebuilds the heap in O(n) bottom up (Floyd), src is
+ * left untouched.
+ */
+//=============================================================================
+static bool
+_heapify_hp(
+    heap *this,
+    vector *src
+)
+//=============================================================================
+{
+    struct heap_t *h = this->_heap;
+    size_t n = 0, i;
+    heap_moved moved;
+    void *ele;
+
+    if (!vop.reserve(&h->_vector, count(h) + src->_vector->_used))
+        return false;
+
+    for (ele = vector_first_element(src, &n); n < src->_vector->_size; n++, ele = vector_next_element(src, &n))
+        vop.push_back(&h->_vector, ele);
+
+    /* positions are only final at the end, report them once */
+    moved = h->_moved;
+    h->_moved = NULL;
+    if (count(h) > 1) {
+        i = parent(h, count(h) - 1) + 1;
+        while (i--)
+            _sift_down_hp(h, i);
+    }
+    h->_moved = moved;
+
+    if (moved) {
+        for (i = 0; i < count(h); i++)
+            moved(h->_moved_ctx, slots(h)[i], i);
+    }
+    return true;
+}
+
+//=============================================================================
+static void
+_clear_hp(
+    heap *this
+)
+//=============================================================================
+{
+    vop.clear(&this->_heap->_vector);
+}
+
+//=============================================================================
+static void
+_set_moved_hp(
+    heap *this,
+    heap_moved moved,
+    void *ctx
+)
+//=============================================================================
+{
+    this->_heap->_moved = moved;
+    this->_heap->_moved_ctx = ctx;
+}
+
+/* Moves the element at pos towards the top, returns false if it stayed where it was. */
+//=============================================================================
+static bool
+_sift_up_hp(
+    struct heap_t *h,
+    size_t pos
+)
+//=============================================================================
+{
+    void **a = slots(h);
+    void *ele = a[pos];
+    size_t start = pos, p;
+    uint64_t key;
+
+    if (h->_key) {
+        key = h->_key(ele);
+        while (pos) {
+            p = parent(h, pos);
+            if (h->_key(a[p]) <= key)
+                break;
+            a[pos] = a[p];
+            if (h->_moved)
+                h->_moved(h->_moved_ctx, a[pos], pos);
+            pos = p;
+        }
+    }
+    else {
+        while (pos) {
+            p = parent(h, pos);
+            if (h->_cmp(h->_ctx, ele, a[p]) >= 0)
+                break;
+            a[pos] = a[p];
+            if (h->_moved)
+                h->_moved(h->_moved_ctx, a[pos], pos);
+            pos = p;
+        }
+    }
+
+    if (pos == start)
+        return false;
+
+    a[pos] = ele;
+    if (h->_moved)
+        h->_moved(h->_moved_ctx, ele, pos);
+    return true;
+}
+
+/* Moves the element at pos down, the hole travels and the element is written once. */
+//=============================================================================
+static void
+_sift_down_hp(
+    struct heap_t *h,
+    size_t pos
+)
+//=============================================================================
+{
+    void **a = slots(h);
+    size_t size = count(h);
+    void *ele = a[pos];
+    size_t c, end, best, i;
+    uint64_t key, bkey, ckey;
+
+    if (h->_key) {
+        key = h->_key(ele);
+        while ((c = child(h, pos)) < size) {
+            end = c + ((size_t)1 << h->_shift);
+            if (end > size)
+                end = size;
+            best = c;
+            bkey = h->_key(a[c]);
+            for (i = c + 1; i < end; i++) {
+                ckey = h->_key(a[i]);
+                if (ckey < bkey) {
+                    best = i;
+                    bkey = ckey;
+                }
+            }
+            if (key <= bkey)
+                break;
+            a[pos] = a[best];
+            if (h->_moved)
+                h->_moved(h->_moved_ctx, a[pos], pos);
+            pos = best;
+        }
+    }
+    else {
+        while ((c = child(h, pos)) < size) {
+            end = c + ((size_t)1 << h->_shift);
+            if (end > size)
+                end = size;
+            best = c;
+            for (i = c + 1; i < end; i++) {
+                if (h->_cmp(h->_ctx, a[i], a[best]) < 0)
+                    best = i;
+            }
+            if (h->_cmp(h->_ctx, ele, a[best]) <= 0)
+                break;
+            a[pos] = a[best];
+            if (h->_moved)
+                h->_moved(h->_moved_ctx, a[pos], pos);
+            pos = best;
+        }
+    }
+
+    a[pos] = ele;
+    if (h->_moved)
+        h->_moved(h->_moved_ctx, ele, pos);
+}
+
+/* EOF */
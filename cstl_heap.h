@@ -0,0 +1,93 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_heap.h
+*
+* DESCRIPTION:     d-ary heap priority queue on vector storage
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_HEAP_H__
+#define __CSTL_HEAP_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+#define CSTL_HEAP_ARITY         4
+
+//===========================
+// Typedefs
+//===========================
+/* < 0 when a must come out before b */
+typedef int (*heap_compare)(void *ctx, const void *a, const void *b);
+/* integer priority, the smallest key comes out first */
+typedef uint64_t (*heap_key)(const void *ele);
+/* ele now sits at pos, keep pos to call update/erase on it later */
+typedef void (*heap_moved)(void *ctx, void *ele, size_t pos);
+
+/*
+ * Min heap of arity 2, 4 or 8 kept densely in _vector, slot 0 is the top. Ordering comes
+ * from _key when set, which is cheaper than _cmp since the key of the element being sifted
+ * is taken once. _moved is told every new position so callers can find an element for
+ * update (decrease/increase key) and erase.
+ */
+typedef struct {
+    struct heap_t {
+        vector _vector;
+        uint32_t _shift;
+        heap_compare _cmp;
+        heap_key _key;
+        void *_ctx;
+        heap_moved _moved;
+        void *_moved_ctx;
+    } *_heap;
+} heap;
+
+typedef struct {
+    bool (*empty)(heap *this);
+    size_t (*size)(heap *this);
+    void *(*top)(heap *this);
+    bool (*push)(heap *this, void *ele);
+    void *(*pop)(heap *this);
+    void (*update)(heap *this, size_t pos);
+    void *(*erase)(heap *this, size_t pos);
+    bool (*heapify)(heap *this, vector *src);
+    void (*clear)(heap *this);
+    void (*set_moved)(heap *this, heap_moved moved, void *ctx);
+} heap_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern heap_operation hpop;
+
+/* Functions */
+void heap_op_init(void);
+struct heap_t *heap_constructor(heap *h, uint32_t tlen, uint32_t arity, heap_compare cmp, void *ctx);
+struct heap_t *heap_constructor_key(heap *h, uint32_t tlen, uint32_t arity, heap_key key);
+void heap_destructor(heap *h);
+
+#endif
+/* EOF */
@@ -0,0 +1,244 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_mmap.c
+*
+* DESCRIPTION:     File backed memory mapped vector
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cstl_mmap.h"
+//===========================
+// Defines
+//===========================
+#define DATA_OFFSET             (CSTL_MAP_HEADER + sizeof(struct vector_t))
+#define align8(n)               (((n) + 7) & ~(size_t)7)
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+static size_t _page_round(size_t len);
+
+//===========================
+// Globals
+//===========================
+
+//=============================================================================
+inline struct vector_t *
+vector_open(
+    vector *v,
+    const char *path,
+    uint32_t tlen
+)
+//=============================================================================
+{
+    static const capacity_policy policy = CAPACITY_POLICY_DEFAULT;
+    struct vector_file_t *hdr;
+    struct vector_t *vec;
+    struct stat st;
+    size_t len;
+    uint8_t *base;
+    int fd;
+
+    _Static_assert(sizeof(struct vector_file_t) <= CSTL_MAP_HEADER, "vector file header too big");
+
+    v->_vector = NULL;
+    if (!tlen)
+        return NULL;
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0)
+        goto err;
+
+    len = st.st_size;
+    if (!len) {
+        len = _page_round(DATA_OFFSET + sizeof(struct bitmap_t));
+        if (ftruncate(fd, len) < 0)
+            goto err;
+    }
+    else if (len < DATA_OFFSET + sizeof(struct bitmap_t)) {
+        goto err;
+    }
+
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        goto err;
+    hdr = (struct vector_file_t *)base;
+    vec = (struct vector_t *)(base + CSTL_MAP_HEADER);
+
+    if (!st.st_size) {
+        hdr->_magic = CSTL_MAP_MAGIC;
+        hdr->_version = CSTL_MAP_VERSION;
+        hdr->_layout = sizeof(struct vector_t);
+        hdr->_bitmap_offset = align8(DATA_OFFSET);
+        vec->_type_len = tlen;
+        vec->_flags = CSTL_VECTOR_MAPPED;
+        vec->_policy = policy;
+    }
+    else if (hdr->_magic != CSTL_MAP_MAGIC || hdr->_version != CSTL_MAP_VERSION || hdr->_layout != sizeof(struct vector_t) ||
+            vec->_type_len != tlen || hdr->_bitmap_offset < DATA_OFFSET + vec->_capacity * tlen ||
+            hdr->_bitmap_offset + sizeof(struct bitmap_t) > len ||
+            hdr->_bitmap_offset + sizeof(struct bitmap_t) + ((struct bitmap_t *)(base + hdr->_bitmap_offset))->_size > len) {
+        munmap(base, len);
+        goto err;
+    }
+
+    /* everything holding an address is only valid in the process that wrote it */
+    hdr->_fd = fd;
+    hdr->_map_len = len;
+    vec->_alloc = &cstl_malloc_allocator;
+    vec->_bitmap = (struct bitmap_t *)(base + hdr->_bitmap_offset);
+    vec->_compact._relocate = NULL;
+    vec->_compact._ctx = NULL;
+    v->_vector = vec;
+#if CSTL_STATS
+    cstl_stats_register(CSTL_STATS_VECTOR, v);
+#endif
+
+    debug(LOG_DEBUG, "vector open: v: %p, _v: %p, size: %ld, capa: %ld, len: %ld", v, vec, vec->_size, vec->_capacity, len);
+    return vec;
+
+err:
+    close(fd);
+    return NULL;
+}
+
+/*
+ * sz bytes of element storage. The bitmap sits right behind the elements, it is moved down
+ * before the file shrinks and moved up after it grew. mremap may move the mapping, the
+ * elements themselves are never copied.
+ */
+//=============================================================================
+inline bool
+vector_map_resize(
+    vector *v,
+    size_t sz
+)
+//=============================================================================
+{
+    struct vector_file_t *hdr = vector_file(v);
+    size_t elements = sz / v->_vector->_type_len;
+    size_t bitbytes = ((elements >> SHIFT) + (elements & MASK ? 1 : 0)) * sizeof(int);
+    size_t offset = align8(DATA_OFFSET + sz);
+    size_t len = _page_round(offset + sizeof(struct bitmap_t) + bitbytes);
+    size_t old_offset = hdr->_bitmap_offset;
+    size_t old_len = hdr->_map_len;
+    size_t keep = v->_vector->_bitmap->_size < bitbytes ? v->_vector->_bitmap->_size : bitbytes;
+    struct bitmap_t *bitmap;
+    uint8_t *base = (uint8_t *)hdr;
+    int fd = hdr->_fd;
+
+    if (offset < old_offset)
+        memmove(base + offset, base + old_offset, sizeof(struct bitmap_t) + keep);
+
+    if (len > old_len) {
+        if (ftruncate(fd, len) < 0)
+            return false;
+        base = mremap(base, old_len, len, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED) {
+            if (ftruncate(fd, old_len) < 0)
+                debug(LOG_ERR, "vector map: can't truncate back to %lu", old_len);
+            return false;
+        }
+    }
+    else if (len < old_len) {
+        /*
+         * a mapping that can't shrink is just left bigger than needed, once it has shrunk
+         * _map_len must follow it, a file left longer than the mapping is harmless
+         */
+        if (mremap(base, old_len, len, 0) == MAP_FAILED)
+            len = old_len;
+        else if (ftruncate(fd, len) < 0)
+            debug(LOG_ERR, "vector map: can't truncate to %lu", len);
+    }
+
+    hdr = (struct vector_file_t *)base;
+    v->_vector = (struct vector_t *)(base + CSTL_MAP_HEADER);
+    if (offset > old_offset)
+        memmove(base + offset, base + old_offset, sizeof(struct bitmap_t) + keep);
+
+    bitmap = (struct bitmap_t *)(base + offset);
+    if (bitbytes > keep)
+        memset((uint8_t *)bitmap->_bitmap + keep, 0, bitbytes - keep);
+    bitmap->_size = bitbytes;
+    hdr->_bitmap_offset = offset;
+    hdr->_map_len = len;
+    v->_vector->_bitmap = bitmap;
+    v->_vector->_capacity = elements;
+    stats_add(v, vector, resizes, 1);
+    stats_sync_v(v);
+    if (offset != old_offset)
+        stats_add(v, vector, bytes_copied, sizeof(struct bitmap_t) + keep);
+
+    debug(LOG_DEBUG, "vector map resize: v: %p, _v: %p, capa: %lu, len: %lu -> %lu", v, v->_vector, elements, old_len, len);
+    return true;
+}
+
+//=============================================================================
+inline bool
+vector_map_sync(
+    vector *v
+)
+//=============================================================================
+{
+    struct vector_file_t *hdr = vector_file(v);
+
+    return msync(hdr, hdr->_map_len, MS_SYNC) == 0;
+}
+
+/* Unmaps and closes the file, whatever wasn't synced yet is still written back by the kernel. */
+//=============================================================================
+inline void
+vector_map_close(
+    vector *v
+)
+//=============================================================================
+{
+    struct vector_file_t *hdr = vector_file(v);
+    int fd = hdr->_fd;
+
+    munmap(hdr, hdr->_map_len);
+    close(fd);
+    v->_vector = NULL;
+}
+
+//=============================================================================
+static size_t
+_page_round(
+    size_t len
+)
+//=============================================================================
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return (len + page - 1) & ~(page - 1);
+}
+
+/* EOF */
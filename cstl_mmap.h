@@ -0,0 +1,81 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_mmap.h
+*
+* DESCRIPTION:     File backed memory mapped vector
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_MMAP_H__
+#define __CSTL_MMAP_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+#define CSTL_MAP_MAGIC          0x3143455654534c43ULL   /* "CSTLVEC1" */
+#define CSTL_MAP_VERSION        1
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * File layout: this header, struct vector_t with the element storage right behind it, then
+ * the bitmap_t at _bitmap_offset. The file is the vector, opening it maps the file and
+ * patches the few process local fields (_alloc, _bitmap, compaction callback), nothing is
+ * parsed or copied. _layout is sizeof(struct vector_t), a file written by a build with a
+ * different layout (CSTL_STATS on/off, other ABI) is refused.
+ */
+struct vector_file_t {
+    uint64_t _magic;
+    uint32_t _version;
+    uint32_t _layout;
+    uint64_t _bitmap_offset;
+    /* process local, rewritten by every vector_open */
+    uint64_t _map_len;
+    int32_t _fd;
+};
+
+#define CSTL_MAP_HEADER         CSTL_CACHELINE
+#define vector_file(vec)        ((struct vector_file_t *)((uint8_t *)(vec)->_vector - CSTL_MAP_HEADER))
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+/*
+ * Attach to the vector stored in path, creating an empty one if the file doesn't exist.
+ * Elements are stored as they are, so they must not be pointers into process memory.
+ * Returns NULL if the file can't be mapped or wasn't written for tlen sized elements.
+ */
+struct vector_t *vector_open(vector *v, const char *path, uint32_t tlen);
+/* used by the vector operations of a mapped vector */
+bool vector_map_resize(vector *v, size_t sz);
+bool vector_map_sync(vector *v);
+void vector_map_close(vector *v);
+
+#endif
+/* EOF */
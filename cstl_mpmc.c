@@ -0,0 +1,313 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_mpmc.c
+*
+* DESCRIPTION:     Bounded lock-free multi producer / multi consumer queue
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include "cstl_mpmc.h"
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+mpmc_queue_operation mqop;
+
+/* Functions */
+static bool _empty_mq(mpmc_queue *this);
+static size_t _size_mq(mpmc_queue *this);
+static size_t _capacity_mq(mpmc_queue *this);
+static bool _try_push_mq(mpmc_queue *this, void *ele);
+static bool _try_pop_mq(mpmc_queue *this, void **ele);
+static size_t _push_n_mq(mpmc_queue *this, void *const *eles, size_t n);
+static size_t _pop_n_mq(mpmc_queue *this, void **eles, size_t n);
+
+//=============================================================================
+inline void
+mpmc_queue_op_init(
+    void
+)
+//=============================================================================
+{
+    mqop.empty = _empty_mq;
+    mqop.size = _size_mq;
+    mqop.capacity = _capacity_mq;
+    mqop.try_push = _try_push_mq;
+    mqop.try_pop = _try_pop_mq;
+    mqop.push_n = _push_n_mq;
+    mqop.pop_n = _pop_n_mq;
+}
+
+/* capacity is rounded up to a power of two of at least 2, the queue never grows. */
+//=============================================================================
+inline struct mpmc_queue_t *
+mpmc_queue_constructor(
+    mpmc_queue *q,
+    uint32_t tlen,
+    size_t capacity
+)
+//=============================================================================
+{
+    size_t cap = 2;
+    size_t len;
+    size_t i;
+
+    while (cap < capacity)
+        cap <<= 1;
+
+    len = sizeof(struct mpmc_queue_t) + cap * sizeof(struct mpmc_cell_t);
+    len = (len + CSTL_CACHELINE - 1) & ~((size_t)CSTL_CACHELINE - 1);
+    q->_queue = (struct mpmc_queue_t *)aligned_alloc(CSTL_CACHELINE, len);
+    if (q->_queue) {
+        memset(q->_queue, 0, sizeof(struct mpmc_queue_t));
+        atomic_init(&q->_queue->_rear, 0);
+        atomic_init(&q->_queue->_front, 0);
+        q->_queue->_capacity = cap;
+        q->_queue->_type_len = tlen;
+        for (i = 0; i < cap; i++) {
+            atomic_init(&q->_queue->_cells[i]._seq, i);
+            q->_queue->_cells[i]._ele = NULL;
+        }
+    }
+
+    debug(LOG_DEBUG, "mpmc queue constructor: q: %p, _q: %p, capa: %ld", q, q->_queue, cap);
+    return q->_queue;
+}
+
+//=============================================================================
+inline void
+mpmc_queue_destructor(
+    mpmc_queue *q
+)
+//=============================================================================
+{
+    if (q->_queue)
+        free(q->_queue);
+    q->_queue = NULL;
+}
+
+//=============================================================================
+static bool
+_empty_mq(
+    mpmc_queue *this
+)
+//=============================================================================
+{
+    return _size_mq(this) ? false : true;
+}
+
+/* a snapshot only, concurrent pushes and pops may change it right away */
+//=============================================================================
+static size_t
+_size_mq(
+    mpmc_queue *this
+)
+//=============================================================================
+{
+    size_t front = atomic_load_explicit(&this->_queue->_front, memory_order_acquire);
+    size_t rear = atomic_load_explicit(&this->_queue->_rear, memory_order_acquire);
+
+    return rear > front ? rear - front : 0;
+}
+
+//=============================================================================
+static size_t
+_capacity_mq(
+    mpmc_queue *this
+)
+//=============================================================================
+{
+    return this->_queue->_capacity;
+}
+
+/* returns false when the queue is full */
+//=============================================================================
+static bool
+_try_push_mq(
+    mpmc_queue *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct mpmc_queue_t *q = this->_queue;
+    struct mpmc_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->_rear, memory_order_relaxed);
+    intptr_t diff;
+
+    for (;;) {
+        cell = &q->_cells[pos & (q->_capacity - 1)];
+        diff = (intptr_t)atomic_load_explicit(&cell->_seq, memory_order_acquire) - (intptr_t)pos;
+        if (!diff) {
+            if (atomic_compare_exchange_weak_explicit(&q->_rear, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&q->_rear, memory_order_relaxed);
+        }
+    }
+
+    cell->_ele = ele;
+    atomic_store_explicit(&cell->_seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/* returns false when the queue is empty */
+//=============================================================================
+static bool
+_try_pop_mq(
+    mpmc_queue *this,
+    void **ele
+)
+//=============================================================================
+{
+    struct mpmc_queue_t *q = this->_queue;
+    struct mpmc_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->_front, memory_order_relaxed);
+    intptr_t diff;
+
+    for (;;) {
+        cell = &q->_cells[pos & (q->_capacity - 1)];
+        diff = (intptr_t)atomic_load_explicit(&cell->_seq, memory_order_acquire) - (intptr_t)(pos + 1);
+        if (!diff) {
+            if (atomic_compare_exchange_weak_explicit(&q->_front, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&q->_front, memory_order_relaxed);
+        }
+    }
+
+    *ele = cell->_ele;
+    atomic_store_explicit(&cell->_seq, pos + q->_capacity, memory_order_release);
+    return true;
+}
+
+/* Push up to n elements with a single CAS on _rear, returns how many were pushed. A cell
+ * that is ready for this lap can only be claimed by whoever moves _rear past it, so the
+ * cells counted before the CAS are still ready once it succeeds.
+ */
+//=============================================================================
+static size_t
+_push_n_mq(
+    mpmc_queue *this,
+    void *const *eles,
+    size_t n
+)
+//=============================================================================
+{
+    struct mpmc_queue_t *q = this->_queue;
+    struct mpmc_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->_rear, memory_order_relaxed);
+    size_t i, k;
+
+    if (n > q->_capacity)
+        n = q->_capacity;
+    if (!n)
+        return 0;
+
+    for (;;) {
+        for (k = 0; k < n; k++) {
+            cell = &q->_cells[(pos + k) & (q->_capacity - 1)];
+            if (atomic_load_explicit(&cell->_seq, memory_order_acquire) != pos + k)
+                break;
+        }
+        if (!k) {
+            cell = &q->_cells[pos & (q->_capacity - 1)];
+            if ((intptr_t)atomic_load_explicit(&cell->_seq, memory_order_acquire) - (intptr_t)pos < 0)
+                return 0;
+            pos = atomic_load_explicit(&q->_rear, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&q->_rear, &pos, pos + k, memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+
+    for (i = 0; i < k; i++) {
+        cell = &q->_cells[(pos + i) & (q->_capacity - 1)];
+        cell->_ele = eles[i];
+        atomic_store_explicit(&cell->_seq, pos + i + 1, memory_order_release);
+    }
+
+    return k;
+}
+
+/* Pop up to n elements into eles with a single CAS on _front, returns how many were popped. */
+//=============================================================================
+static size_t
+_pop_n_mq(
+    mpmc_queue *this,
+    void **eles,
+    size_t n
+)
+//=============================================================================
+{
+    struct mpmc_queue_t *q = this->_queue;
+    struct mpmc_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->_front, memory_order_relaxed);
+    size_t i, k;
+
+    if (n > q->_capacity)
+        n = q->_capacity;
+    if (!n)
+        return 0;
+
+    for (;;) {
+        for (k = 0; k < n; k++) {
+            cell = &q->_cells[(pos + k) & (q->_capacity - 1)];
+            if (atomic_load_explicit(&cell->_seq, memory_order_acquire) != pos + k + 1)
+                break;
+        }
+        if (!k) {
+            cell = &q->_cells[pos & (q->_capacity - 1)];
+            if ((intptr_t)atomic_load_explicit(&cell->_seq, memory_order_acquire) - (intptr_t)(pos + 1) < 0)
+                return 0;
+            pos = atomic_load_explicit(&q->_front, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&q->_front, &pos, pos + k, memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+
+    for (i = 0; i < k; i++) {
+        cell = &q->_cells[(pos + i) & (q->_capacity - 1)];
+        eles[i] = cell->_ele;
+        atomic_store_explicit(&cell->_seq, pos + i + q->_capacity, memory_order_release);
+    }
+
+    return k;
+}
+
+/* EOF */
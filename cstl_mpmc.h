@@ -0,0 +1,82 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_mpmc.h
+*
+* DESCRIPTION:     Bounded lock-free multi producer / multi consumer queue
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_MPMC_H__
+#define __CSTL_MPMC_H__
+
+//===========================
+// Includes
+//===========================
+#include <stdatomic.h>
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Fixed capacity queue for any number of producers and consumers, after Dmitry Vyukov's
+ * bounded MPMC queue. Every cell carries a sequence number telling which lap of the ring
+ * it is ready for, so producers and consumers only contend on their own index with one
+ * CAS and never on each other.
+ */
+typedef struct {
+    struct mpmc_queue_t {
+        _Alignas(CSTL_CACHELINE) atomic_size_t _rear;
+        _Alignas(CSTL_CACHELINE) atomic_size_t _front;
+        _Alignas(CSTL_CACHELINE) size_t _capacity;
+        uint32_t _type_len;
+        struct mpmc_cell_t {
+            atomic_size_t _seq;
+            void *_ele;
+        } _cells[];
+    } *_queue;
+} mpmc_queue;
+
+typedef struct {
+    bool (*empty)(mpmc_queue *this);
+    size_t (*size)(mpmc_queue *this);
+    size_t (*capacity)(mpmc_queue *this);
+    bool (*try_push)(mpmc_queue *this, void *ele);
+    bool (*try_pop)(mpmc_queue *this, void **ele);
+    size_t (*push_n)(mpmc_queue *this, void *const *eles, size_t n);
+    size_t (*pop_n)(mpmc_queue *this, void **eles, size_t n);
+} mpmc_queue_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern mpmc_queue_operation mqop;
+
+/* Functions */
+void mpmc_queue_op_init(void);
+struct mpmc_queue_t *mpmc_queue_constructor(mpmc_queue *q, uint32_t tlen, size_t capacity);
+void mpmc_queue_destructor(mpmc_queue *q);
+
+#endif
+/* EOF */
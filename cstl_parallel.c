@@ -0,0 +1,600 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_parallel.c
+*
+* DESCRIPTION:     Parallel algorithms over vector on a work stealing thread pool
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include <unistd.h>
+#include "cstl_parallel.h"
+//===========================
+// Defines
+//===========================
+/* walk the live slots of one task */
+#define for_each_task_slot(job, c, n, end, map) \
+    for (n = (c) * (job)->_slots, end = n + (job)->_slots < (job)->_size ? n + (job)->_slots : (job)->_size, \
+            map = (job)->_vec->_vector->_bitmap->_bitmap, n = _bitmap_next(map, end, n); \
+            n < end; n = _bitmap_next(map, end, n + 1))
+
+//===========================
+// Typedefs
+//===========================
+struct par_job_t {
+    vector *_vec;
+    size_t _size;
+    size_t _slots;
+    size_t _chunks;
+    void (*_run)(struct par_job_t *job, size_t c);
+    void *_ctx;
+    par_visit _visit;
+    par_map _map;
+    par_pred _pred;
+    par_combine _combine;
+    void *_identity;
+    void **_partials;
+    size_t *_offsets;
+    uint32_t *_match;
+    void **_out;
+    atomic_size_t _result;
+};
+
+//===========================
+// Locals
+//===========================
+static void *_worker_pp(void *arg);
+static void _steal_pp(struct par_pool_t *pool, struct par_job_t *job, size_t id);
+static void _dispatch_pp(par_pool *p, struct par_job_t *job);
+static void _job_init_pp(par_pool *p, struct par_job_t *job, vector *v, void (*run)(struct par_job_t *job, size_t c), void *ctx);
+static void _for_each_run(struct par_job_t *job, size_t c);
+static void _transform_run(struct par_job_t *job, size_t c);
+static void _reduce_run(struct par_job_t *job, size_t c);
+static void _find_first_run(struct par_job_t *job, size_t c);
+static void _count_run(struct par_job_t *job, size_t c);
+static void _partition_count_run(struct par_job_t *job, size_t c);
+static void _partition_move_run(struct par_job_t *job, size_t c);
+
+//===========================
+// Globals
+//===========================
+
+//=============================================================================
+inline struct par_pool_t *
+par_pool_constructor(
+    par_pool *p,
+    size_t threads,
+    size_t grain
+)
+//=============================================================================
+{
+    struct par_pool_t *pool;
+    long cpus;
+    size_t i;
+
+    if (!threads) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+
+    p->_pool = pool = (struct par_pool_t *)calloc(1, sizeof(struct par_pool_t));
+    if (!pool)
+        return NULL;
+
+    pool->_threads = threads;
+    pool->_grain = grain ? grain : CSTL_PAR_GRAIN;
+    pool->_tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    pool->_ranges = (struct par_range_t *)aligned_alloc(CSTL_CACHELINE, threads * sizeof(struct par_range_t));
+    if (!pool->_tids || !pool->_ranges)
+        goto err;
+
+    pthread_mutex_init(&pool->_job_lock, NULL);
+    pthread_mutex_init(&pool->_lock, NULL);
+    pthread_cond_init(&pool->_work, NULL);
+    pthread_cond_init(&pool->_done, NULL);
+    for (i = 0; i < threads; i++) {
+        atomic_init(&pool->_ranges[i]._next, 0);
+        pool->_ranges[i]._end = 0;
+        pool->_ranges[i]._pool = pool;
+    }
+
+    /* the caller is thread 0 */
+    for (i = 1; i < threads; i++) {
+        if (pthread_create(&pool->_tids[i], NULL, _worker_pp, &pool->_ranges[i])) {
+            pool->_threads = i;
+            par_pool_destructor(p);
+            return NULL;
+        }
+    }
+
+    debug(LOG_DEBUG, "par pool constructor: p: %p, _p: %p, threads: %lu", p, pool, threads);
+    return pool;
+
+err:
+    free(pool->_tids);
+    free(pool->_ranges);
+    free(pool);
+    p->_pool = NULL;
+    return NULL;
+}
+
+//=============================================================================
+inline void
+par_pool_destructor(
+    par_pool *p
+)
+//=============================================================================
+{
+    struct par_pool_t *pool = p->_pool;
+    size_t i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->_lock);
+    pool->_stop = true;
+    pthread_cond_broadcast(&pool->_work);
+    pthread_mutex_unlock(&pool->_lock);
+    for (i = 1; i < pool->_threads; i++)
+        pthread_join(pool->_tids[i], NULL);
+
+    pthread_mutex_destroy(&pool->_job_lock);
+    pthread_mutex_destroy(&pool->_lock);
+    pthread_cond_destroy(&pool->_work);
+    pthread_cond_destroy(&pool->_done);
+    free(pool->_tids);
+    free(pool->_ranges);
+    free(pool);
+    p->_pool = NULL;
+}
+
+//=============================================================================
+inline void
+par_for_each(
+    par_pool *p,
+    vector *v,
+    par_visit fn,
+    void *ctx
+)
+//=============================================================================
+{
+    struct par_job_t job;
+
+    _job_init_pp(p, &job, v, _for_each_run, ctx);
+    job._visit = fn;
+    _dispatch_pp(p, &job);
+}
+
+//=============================================================================
+inline void
+par_transform(
+    par_pool *p,
+    vector *v,
+    par_map fn,
+    void *ctx
+)
+//=============================================================================
+{
+    struct par_job_t job;
+
+    _job_init_pp(p, &job, v, _transform_run, ctx);
+    job._map = fn;
+    _dispatch_pp(p, &job);
+}
+
+/* Every task folds its slots into its own partial, the caller folds the partials in order. */
+//=============================================================================
+inline void *
+par_reduce(
+    par_pool *p,
+    vector *v,
+    void *identity,
+    par_combine combine,
+    void *ctx
+)
+//=============================================================================
+{
+    struct par_job_t job;
+    void *acc = identity;
+    size_t c;
+
+    _job_init_pp(p, &job, v, _reduce_run, ctx);
+    job._combine = combine;
+    job._identity = identity;
+    job._partials = (void **)malloc(job._chunks * sizeof(void *));
+    if (!job._partials) {
+        /* one task spanning the whole vector, folded right here */
+        job._slots = job._size;
+        job._chunks = 1;
+        job._partials = &acc;
+        _reduce_run(&job, 0);
+        return acc;
+    }
+
+    _dispatch_pp(p, &job);
+    for (c = 0; c < job._chunks; c++)
+        acc = combine(ctx, acc, job._partials[c]);
+    free(job._partials);
+    return acc;
+}
+
+//=============================================================================
+inline size_t
+par_find_first(
+    par_pool *p,
+    vector *v,
+    par_pred pred,
+    void *ctx
+)
+//=============================================================================
+{
+    struct par_job_t job;
+
+    _job_init_pp(p, &job, v, _find_first_run, ctx);
+    job._pred = pred;
+    atomic_init(&job._result, job._size);
+    _dispatch_pp(p, &job);
+    return atomic_load(&job._result);
+}
+
+//=============================================================================
+inline size_t
+par_count(
+    par_pool *p,
+    vector *v,
+    par_pred pred,
+    void *ctx
+)
+//=============================================================================
+{
+    struct par_job_t job;
+
+    _job_init_pp(p, &job, v, _count_run, ctx);
+    job._pred = pred;
+    _dispatch_pp(p, &job);
+    return atomic_load(&job._result);
+}
+
+/*
+ * Two passes over the same tasks. The first counts matches and live elements per task and
+ * remembers pred's answer in a scratch bitmap, a prefix sum then gives every task the two
+ * places its elements go to, the second pass moves them to a scratch array that is copied
+ * back dense.
+ */
+//=============================================================================
+inline size_t
+par_partition(
+    par_pool *p,
+    vector *v,
+    par_pred pred,
+    void *ctx
+)
+//=============================================================================
+{
+    struct vector_t *vec = v->_vector;
+    struct par_job_t job;
+    size_t c, t, f, matches = 0, used = vec->_used;
+
+    _job_init_pp(p, &job, v, _partition_count_run, ctx);
+    job._pred = pred;
+    job._offsets = (size_t *)malloc(job._chunks * 2 * sizeof(size_t) + 1);
+    job._match = (uint32_t *)calloc(1, vec->_bitmap->_size + sizeof(uint32_t));
+    job._out = (void **)malloc(used * sizeof(void *) + 1);
+    if (!job._offsets || !job._match || !job._out) {
+        matches = (size_t)-1;
+        goto out;
+    }
+
+    _dispatch_pp(p, &job);
+    for (c = 0; c < job._chunks; c++)
+        matches += job._offsets[c * 2];
+
+    for (c = 0, t = 0, f = matches; c < job._chunks; c++) {
+        size_t ct = job._offsets[c * 2], cl = job._offsets[c * 2 + 1];
+
+        job._offsets[c * 2] = t;
+        job._offsets[c * 2 + 1] = f;
+        t += ct;
+        f += cl - ct;
+    }
+
+    job._run = _partition_move_run;
+    _dispatch_pp(p, &job);
+
+    memcpy(vec->_vector, job._out, used * sizeof(void *));
+    memset(vec->_bitmap->_bitmap, 0, vec->_bitmap->_size);
+    _bit_set_range_v(v, 0, used);
+    vec->_size = used;
+    stats_sync_v(v);
+    vec->_hint = used;
+    vec->_compact._active = false;
+
+out:
+    free(job._offsets);
+    free(job._match);
+    free(job._out);
+    return matches;
+}
+
+//=============================================================================
+static void *
+_worker_pp(
+    void *arg
+)
+//=============================================================================
+{
+    struct par_range_t *range = (struct par_range_t *)arg;
+    struct par_pool_t *pool = range->_pool;
+    size_t id = range - pool->_ranges;
+    struct par_job_t *job;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->_lock);
+        while (pool->_gen == seen && !pool->_stop)
+            pthread_cond_wait(&pool->_work, &pool->_lock);
+        if (pool->_stop) {
+            pthread_mutex_unlock(&pool->_lock);
+            break;
+        }
+        seen = pool->_gen;
+        job = pool->_job;
+        pthread_mutex_unlock(&pool->_lock);
+
+        _steal_pp(pool, job, id);
+
+        pthread_mutex_lock(&pool->_lock);
+        if (!--pool->_busy)
+            pthread_cond_signal(&pool->_done);
+        pthread_mutex_unlock(&pool->_lock);
+    }
+
+    return NULL;
+}
+
+/* Own share first, then the others' in turn. The cursors may run past _end, that is harmless. */
+//=============================================================================
+static void
+_steal_pp(
+    struct par_pool_t *pool,
+    struct par_job_t *job,
+    size_t id
+)
+//=============================================================================
+{
+    struct par_range_t *r;
+    size_t i, c;
+
+    for (i = 0; i < pool->_threads; i++) {
+        r = &pool->_ranges[(id + i) % pool->_threads];
+        while ((c = atomic_fetch_add_explicit(&r->_next, 1, memory_order_relaxed)) < r->_end)
+            job->_run(job, c);
+    }
+}
+
+//=============================================================================
+static void
+_dispatch_pp(
+    par_pool *p,
+    struct par_job_t *job
+)
+//=============================================================================
+{
+    struct par_pool_t *pool = p ? p->_pool : NULL;
+    size_t i, share, rem, start;
+
+    if (!job->_chunks)
+        return;
+
+    if (!pool || pool->_threads == 1 || job->_chunks == 1) {
+        for (i = 0; i < job->_chunks; i++)
+            job->_run(job, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->_job_lock);
+    share = job->_chunks / pool->_threads;
+    rem = job->_chunks % pool->_threads;
+    for (i = 0, start = 0; i < pool->_threads; i++) {
+        atomic_store_explicit(&pool->_ranges[i]._next, start, memory_order_relaxed);
+        start += share + (i < rem ? 1 : 0);
+        pool->_ranges[i]._end = start;
+    }
+
+    /* the mutex publishes the job and the ranges, and later the workers' results */
+    pthread_mutex_lock(&pool->_lock);
+    pool->_job = job;
+    pool->_busy = pool->_threads - 1;
+    pool->_gen++;
+    pthread_cond_broadcast(&pool->_work);
+    pthread_mutex_unlock(&pool->_lock);
+
+    _steal_pp(pool, job, 0);
+
+    pthread_mutex_lock(&pool->_lock);
+    while (pool->_busy)
+        pthread_cond_wait(&pool->_done, &pool->_lock);
+    pool->_job = NULL;
+    pthread_mutex_unlock(&pool->_lock);
+    pthread_mutex_unlock(&pool->_job_lock);
+}
+
+//=============================================================================
+static void
+_job_init_pp(
+    par_pool *p,
+    struct par_job_t *job,
+    vector *v,
+    void (*run)(struct par_job_t *job, size_t c),
+    void *ctx
+)
+//=============================================================================
+{
+    memset(job, 0, sizeof(*job));
+    job->_vec = v;
+    job->_size = v->_vector->_size;
+    job->_slots = (p && p->_pool ? p->_pool->_grain : CSTL_PAR_GRAIN) << SHIFT;
+    job->_chunks = (job->_size + job->_slots - 1) / job->_slots;
+    job->_run = run;
+    job->_ctx = ctx;
+    atomic_init(&job->_result, 0);
+}
+
+//=============================================================================
+static void
+_for_each_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    const uint32_t *map;
+    size_t n, end;
+
+    for_each_task_slot(job, c, n, end, map)
+        job->_visit(job->_ctx, slots[n], n);
+}
+
+//=============================================================================
+static void
+_transform_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    const uint32_t *map;
+    size_t n, end;
+
+    for_each_task_slot(job, c, n, end, map)
+        slots[n] = job->_map(job->_ctx, slots[n], n);
+}
+
+//=============================================================================
+static void
+_reduce_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    void *acc = job->_identity;
+    const uint32_t *map;
+    size_t n, end;
+
+    for_each_task_slot(job, c, n, end, map)
+        acc = job->_combine(job->_ctx, acc, slots[n]);
+    job->_partials[c] = acc;
+}
+
+/* Tasks starting past the best match so far are skipped, a running one stops once it passes it. */
+//=============================================================================
+static void
+_find_first_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    const uint32_t *map;
+    size_t n, end, best;
+
+    if (c * job->_slots >= atomic_load_explicit(&job->_result, memory_order_relaxed))
+        return;
+
+    for_each_task_slot(job, c, n, end, map) {
+        best = atomic_load_explicit(&job->_result, memory_order_relaxed);
+        if (n >= best)
+            return;
+        if (job->_pred(job->_ctx, slots[n])) {
+            while (n < best && !atomic_compare_exchange_weak_explicit(&job->_result, &best, n, memory_order_relaxed, memory_order_relaxed))
+                ;
+            return;
+        }
+    }
+}
+
+//=============================================================================
+static void
+_count_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    const uint32_t *map;
+    size_t n, end, count = 0;
+
+    for_each_task_slot(job, c, n, end, map)
+        count += job->_pred(job->_ctx, slots[n]) ? 1 : 0;
+    if (count)
+        atomic_fetch_add_explicit(&job->_result, count, memory_order_relaxed);
+}
+
+/* tasks are whole bitmap words, so each one owns the _match words it writes */
+//=============================================================================
+static void
+_partition_count_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    const uint32_t *map;
+    size_t n, end, t = 0, l = 0;
+
+    for_each_task_slot(job, c, n, end, map) {
+        l++;
+        if (job->_pred(job->_ctx, slots[n])) {
+            job->_match[n >> SHIFT] |= 1U << (n & MASK);
+            t++;
+        }
+    }
+    job->_offsets[c * 2] = t;
+    job->_offsets[c * 2 + 1] = l;
+}
+
+//=============================================================================
+static void
+_partition_move_run(
+    struct par_job_t *job,
+    size_t c
+)
+//=============================================================================
+{
+    void **slots = job->_vec->_vector->_vector;
+    size_t t = job->_offsets[c * 2], f = job->_offsets[c * 2 + 1];
+    const uint32_t *map;
+    size_t n, end;
+
+    for_each_task_slot(job, c, n, end, map) {
+        if (job->_match[n >> SHIFT] & (1U << (n & MASK)))
+            job->_out[t++] = slots[n];
+        else
+            job->_out[f++] = slots[n];
+    }
+}
+
+/* EOF */
@@ -0,0 +1,111 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_parallel.h
+*
+* DESCRIPTION:     Parallel algorithms over vector on a work stealing thread pool
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_PARALLEL_H__
+#define __CSTL_PARALLEL_H__
+
+//===========================
+// Includes
+//===========================
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+/* bitmap words per task, a task covers CSTL_PAR_GRAIN * 32 slots */
+#define CSTL_PAR_GRAIN          256
+
+//===========================
+// Typedefs
+//===========================
+typedef void (*par_visit)(void *ctx, void *ele, size_t n);
+typedef void *(*par_map)(void *ctx, void *ele, size_t n);
+typedef bool (*par_pred)(void *ctx, void *ele);
+typedef void *(*par_combine)(void *ctx, void *a, void *b);
+
+struct par_job_t;
+
+/*
+ * The calling thread plus _threads - 1 workers. A job is cut into tasks on bitmap word
+ * boundaries, each thread starts on its own contiguous share of the tasks and when that is
+ * done steals from the others, taking a task is one fetch_add on the owner's cursor. One
+ * job runs at a time, concurrent calls on the same pool queue up on _job_lock.
+ */
+typedef struct {
+    struct par_pool_t {
+        size_t _threads;
+        size_t _grain;
+        pthread_t *_tids;
+        pthread_mutex_t _job_lock;
+        pthread_mutex_t _lock;
+        pthread_cond_t _work;
+        pthread_cond_t _done;
+        uint64_t _gen;
+        size_t _busy;
+        bool _stop;
+        struct par_job_t *_job;
+        struct par_range_t {
+            _Alignas(CSTL_CACHELINE) atomic_size_t _next;
+            size_t _end;
+            /* handed to worker i as its argument */
+            struct par_pool_t *_pool;
+        } *_ranges;
+    } *_pool;
+} par_pool;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+/* threads 0 uses every online cpu, grain 0 means CSTL_PAR_GRAIN */
+struct par_pool_t *par_pool_constructor(par_pool *p, size_t threads, size_t grain);
+void par_pool_destructor(par_pool *p);
+
+/*
+ * Each call takes a pool, NULL runs the algorithm on the calling thread alone. fn gets the
+ * live elements with their index, concurrently and in no particular order, and must not
+ * change the vector.
+ */
+void par_for_each(par_pool *p, vector *v, par_visit fn, void *ctx);
+/* every live element is replaced by fn's result */
+void par_transform(par_pool *p, vector *v, par_map fn, void *ctx);
+/* combine must be associative and identity its neutral element, results are combined in index order */
+void *par_reduce(par_pool *p, vector *v, void *identity, par_combine combine, void *ctx);
+/* lowest index of a live element matching pred, or _size, tasks behind a match are cancelled */
+size_t par_find_first(par_pool *p, vector *v, par_pred pred, void *ctx);
+size_t par_count(par_pool *p, vector *v, par_pred pred, void *ctx);
+/*
+ * Stable partition, the live elements matching pred come first and the rest follow, both
+ * in their old order. Tombstones are dropped, so indexes change. Returns the number of
+ * matches or (size_t)-1 if the scratch buffer couldn't be allocated.
+ */
+size_t par_partition(par_pool *p, vector *v, par_pred pred, void *ctx);
+
+#endif
+/* EOF */
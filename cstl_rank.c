@@ -0,0 +1,267 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_rank.c
+*
+* DESCRIPTION:     Rank and select index over the vector occupancy bitmap
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#include "cstl_rank.h"
+//===========================
+// Defines
+//===========================
+#define map_words(size)         (((size) + MASK) >> SHIFT)
+#define stale(r)                ((r)->_gen != (r)->_vec->_vector->_gen || (r)->_size != (r)->_vec->_vector->_size)
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+static bool _fresh_ri(struct rank_index_t *r);
+static uint32_t _select_word(uint32_t word, uint32_t k);
+
+//===========================
+// Globals
+//===========================
+
+//=============================================================================
+inline struct rank_index_t *
+rank_index_constructor(
+    rank_index *r,
+    vector *v
+)
+//=============================================================================
+{
+    r->_rank = (struct rank_index_t *)calloc(1, sizeof(struct rank_index_t));
+    if (!r->_rank)
+        return NULL;
+
+    r->_rank->_vec = v;
+    if (!rank_index_build(r)) {
+        free(r->_rank);
+        r->_rank = NULL;
+        return NULL;
+    }
+
+    debug(LOG_DEBUG, "rank index constructor: r: %p, _r: %p, v: %p, live: %lu", r, r->_rank, v, r->_rank->_live);
+    return r->_rank;
+}
+
+//=============================================================================
+inline void
+rank_index_destructor(
+    rank_index *r
+)
+//=============================================================================
+{
+    const cstl_allocator *alloc;
+
+    if (!r->_rank)
+        return;
+
+    alloc = r->_rank->_vec->_vector->_alloc;
+    if (r->_rank->_bytes)
+        alloc->free(alloc->ctx, r->_rank->_super, r->_rank->_bytes);
+    free(r->_rank);
+    r->_rank = NULL;
+}
+
+/* one pass of popcounts over the bitmap, the arrays are only reallocated when they grow */
+//=============================================================================
+inline bool
+rank_index_build(
+    rank_index *r
+)
+//=============================================================================
+{
+    struct rank_index_t *idx = r->_rank;
+    struct vector_t *vec = idx->_vec->_vector;
+    const cstl_allocator *alloc = vec->_alloc;
+    const uint32_t *map = vec->_bitmap->_bitmap;
+    size_t words = map_words(vec->_size);
+    size_t blocks = (words + CSTL_RANK_WORDS - 1) / CSTL_RANK_WORDS;
+    size_t samples = vec->_size / CSTL_RANK_SAMPLE + 1;
+    size_t bytes = (blocks + 1 + samples) * sizeof(size_t) + words * sizeof(uint16_t);
+    size_t live = 0;
+    size_t b, w, end, in;
+    size_t *mem;
+
+    if (bytes > idx->_bytes) {
+        mem = alloc->realloc(alloc->ctx, idx->_bytes ? idx->_super : NULL, idx->_bytes, bytes);
+        if (!mem)
+            return false;
+        idx->_super = mem;
+        idx->_bytes = bytes;
+    }
+    idx->_select = idx->_super + blocks + 1;
+    idx->_word = (uint16_t *)(idx->_select + samples);
+
+    idx->_samples = 0;
+    for (b = 0; b < blocks; b++) {
+        idx->_super[b] = live;
+        end = (b + 1) * CSTL_RANK_WORDS < words ? (b + 1) * CSTL_RANK_WORDS : words;
+        for (in = 0, w = b * CSTL_RANK_WORDS; w < end; w++) {
+            idx->_word[w] = in;
+            in += __builtin_popcount(map[w]);
+        }
+        live += in;
+        /* every sample that falls into this block */
+        while (idx->_samples * CSTL_RANK_SAMPLE < live)
+            idx->_select[idx->_samples++] = b;
+    }
+    idx->_super[blocks] = live;
+
+    idx->_blocks = blocks;
+    idx->_live = live;
+    idx->_size = vec->_size;
+    idx->_gen = vec->_gen;
+    return true;
+}
+
+//=============================================================================
+inline size_t
+vector_rank(
+    rank_index *r,
+    size_t n
+)
+//=============================================================================
+{
+    struct rank_index_t *idx = r->_rank;
+    size_t w = n >> SHIFT;
+
+    if (!_fresh_ri(idx))
+        return (size_t)-1;
+    if (n >= idx->_size)
+        return idx->_live;
+
+    return idx->_super[w / CSTL_RANK_WORDS] + idx->_word[w] +
+            __builtin_popcount(idx->_vec->_vector->_bitmap->_bitmap[w] & ((1U << (n & MASK)) - 1));
+}
+
+//=============================================================================
+inline size_t
+vector_select(
+    rank_index *r,
+    size_t k
+)
+//=============================================================================
+{
+    struct rank_index_t *idx = r->_rank;
+    size_t j = k / CSTL_RANK_SAMPLE;
+    size_t lo, hi, mid, w, end;
+
+    if (!_fresh_ri(idx))
+        return (size_t)-1;
+    if (k >= idx->_live)
+        return idx->_size;
+
+    /* the last block whose prefix is <= k, between this sample's block and the next one's */
+    lo = idx->_select[j];
+    hi = j + 1 < idx->_samples ? idx->_select[j + 1] : idx->_blocks - 1;
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (idx->_super[mid] <= k)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    k -= idx->_super[lo];
+    w = lo * CSTL_RANK_WORDS;
+    end = map_words(idx->_size);
+    while (w + 1 < end && (w + 1) % CSTL_RANK_WORDS && idx->_word[w + 1] <= k)
+        w++;
+
+    return (w << SHIFT) + _select_word(idx->_vec->_vector->_bitmap->_bitmap[w], k - idx->_word[w]);
+}
+
+//=============================================================================
+inline void *
+vector_at_live(
+    rank_index *r,
+    size_t k
+)
+//=============================================================================
+{
+    size_t n = vector_select(r, k);
+
+    if (n == (size_t)-1 || n >= r->_rank->_size)
+        return NULL;
+
+    return r->_rank->_vec->_vector->_vector[n];
+}
+
+//=============================================================================
+inline size_t
+vector_count_live(
+    rank_index *r,
+    size_t from,
+    size_t to
+)
+//=============================================================================
+{
+    size_t lo, hi;
+
+    if (from >= to)
+        return 0;
+    lo = vector_rank(r, from);
+    hi = vector_rank(r, to);
+    if (lo == (size_t)-1 || hi == (size_t)-1)
+        return (size_t)-1;
+
+    return hi - lo;
+}
+
+//=============================================================================
+static bool
+_fresh_ri(
+    struct rank_index_t *r
+)
+//=============================================================================
+{
+    rank_index h = { r };
+
+    return stale(r) ? rank_index_build(&h) : true;
+}
+
+/* position of the k-th set bit of word, counting from 0, the word has more than k bits set */
+//=============================================================================
+static uint32_t
+_select_word(
+    uint32_t word,
+    uint32_t k
+)
+//=============================================================================
+{
+#if defined(__BMI2__)
+    return __builtin_ctz(_pdep_u32(1U << k, word));
+#else
+    while (k--)
+        word &= word - 1;
+    return __builtin_ctz(word);
+#endif
+}
+
+/* EOF */
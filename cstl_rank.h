@@ -0,0 +1,91 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_rank.h
+*
+* DESCRIPTION:     Rank and select index over the vector occupancy bitmap
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_RANK_H__
+#define __CSTL_RANK_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+/* bitmap words per rank block, 512 slots */
+#define CSTL_RANK_WORDS         16
+/* live slots between two select samples */
+#define CSTL_RANK_SAMPLE        512
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Index over the live slots of a vector, built from the bitmap and rebuilt on the next query
+ * after the vector changed (vector_t._gen). _super holds the live slots before every block
+ * plus a final total, _word the live slots before every word within its block and _select
+ * the block of every CSTL_RANK_SAMPLE-th live slot. The arrays share one allocation from the
+ * vector's allocator.
+ */
+typedef struct {
+    struct rank_index_t {
+        vector *_vec;
+        size_t _gen;
+        size_t _size;
+        size_t _live;
+        size_t _blocks;
+        size_t _samples;
+        size_t _bytes;
+        size_t *_super;
+        size_t *_select;
+        uint16_t *_word;
+    } *_rank;
+} rank_index;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+/* v must stay valid while the index is used, the index reads v->_vector on every query */
+struct rank_index_t *rank_index_constructor(rank_index *r, vector *v);
+void rank_index_destructor(rank_index *r);
+/* rebuild now instead of on the next query, false if out of memory */
+bool rank_index_build(rank_index *r);
+/*
+ * The queries return (size_t)-1 (vector_at_live NULL) if a needed rebuild runs out of
+ * memory. rank and count_live are O(1), select is O(1) unless the sample it starts from
+ * is followed by long empty stretches, which are binary searched.
+ */
+/* live slots before slot n */
+size_t vector_rank(rank_index *r, size_t n);
+/* slot of the k-th live element counting from 0, or _size when there are fewer */
+size_t vector_select(rank_index *r, size_t k);
+void *vector_at_live(rank_index *r, size_t k);
+/* live slots in [from, to) */
+size_t vector_count_live(rank_index *r, size_t from, size_t to);
+
+#endif
+/* EOF */
@@ -0,0 +1,233 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_slotmap.c
+*
+* DESCRIPTION:     Slot map with generation checked handles
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include "cstl_slotmap.h"
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+slotmap_operation smop;
+
+/* Functions */
+static bool _empty_sm(slotmap *this);
+static size_t _size_sm(slotmap *this);
+static slot_handle _insert_sm(slotmap *this, void *ele);
+static bool _erase_sm(slotmap *this, slot_handle h);
+static void *_get_sm(slotmap *this, slot_handle h);
+static bool _valid_sm(slotmap *this, slot_handle h);
+static void _clear_sm(slotmap *this);
+
+//=============================================================================
+inline void
+slotmap_op_init(
+    void
+)
+//=============================================================================
+{
+    vector_op_init();
+
+    smop.empty = _empty_sm;
+    smop.size = _size_sm;
+    smop.insert = _insert_sm;
+    smop.erase = _erase_sm;
+    smop.get = _get_sm;
+    smop.valid = _valid_sm;
+    smop.clear = _clear_sm;
+}
+
+//=============================================================================
+inline struct slotmap_t *
+slotmap_constructor(
+    slotmap *m,
+    uint32_t tlen
+)
+//=============================================================================
+{
+    m->_slotmap = (struct slotmap_t *)calloc(1, sizeof(struct slotmap_t));
+    if (!m->_slotmap)
+        return NULL;
+
+    if (!vector_constructor(&m->_slotmap->_vector, tlen)) {
+        free(m->_slotmap);
+        m->_slotmap = NULL;
+    }
+
+    debug(LOG_DEBUG, "slotmap constructor: m: %p, _m: %p", m, m->_slotmap);
+    return m->_slotmap;
+}
+
+//=============================================================================
+inline void
+slotmap_destructor(
+    slotmap *m
+)
+//=============================================================================
+{
+    if (!m->_slotmap)
+        return;
+
+    vector_destructor(&m->_slotmap->_vector);
+    free(m->_slotmap->_gen);
+    free(m->_slotmap);
+    m->_slotmap = NULL;
+}
+
+//=============================================================================
+static bool
+_empty_sm(
+    slotmap *this
+)
+//=============================================================================
+{
+    return vop.empty(&this->_slotmap->_vector);
+}
+
+//=============================================================================
+static size_t
+_size_sm(
+    slotmap *this
+)
+//=============================================================================
+{
+    return this->_slotmap->_vector._vector->_used;
+}
+
+/* Returns the handle of the new element, or SLOT_HANDLE_NULL if the map couldn't grow. */
+//=============================================================================
+static slot_handle
+_insert_sm(
+    slotmap *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct slotmap_t *m = this->_slotmap;
+    size_t n = vop.insert(&m->_vector, ele);
+    size_t size;
+    uint32_t *gen;
+
+    if (n == (size_t)-1 || n > 0xffffffff) {
+        if (n != (size_t)-1)
+            vop.erase(&m->_vector, n);
+        return SLOT_HANDLE_NULL;
+    }
+
+    if (n >= m->_gen_size) {
+        size = m->_vector._vector->_capacity;
+        gen = (uint32_t *)realloc(m->_gen, size * sizeof(uint32_t));
+        if (!gen) {
+            vop.erase(&m->_vector, n);
+            return SLOT_HANDLE_NULL;
+        }
+        memset(gen + m->_gen_size, 0, (size - m->_gen_size) * sizeof(uint32_t));
+        m->_gen = gen;
+        m->_gen_size = size;
+    }
+    if (!m->_gen[n])
+        m->_gen[n] = 1;
+
+    return ((slot_handle)m->_gen[n] << 32) | n;
+}
+
+//=============================================================================
+static bool
+_erase_sm(
+    slotmap *this,
+    slot_handle h
+)
+//=============================================================================
+{
+    struct slotmap_t *m = this->_slotmap;
+    size_t n = slot_index(h);
+
+    if (!_valid_sm(this, h))
+        return false;
+
+    vop.erase(&m->_vector, n);
+    /* 0 is reserved for never used slots */
+    if (!++m->_gen[n])
+        m->_gen[n] = 1;
+
+    return true;
+}
+
+/* Returns the element h refers to, or NULL if it has been erased. */
+//=============================================================================
+static void *
+_get_sm(
+    slotmap *this,
+    slot_handle h
+)
+//=============================================================================
+{
+    if (!_valid_sm(this, h))
+        return NULL;
+
+    return vop.at(&this->_slotmap->_vector, slot_index(h));
+}
+
+//=============================================================================
+static bool
+_valid_sm(
+    slotmap *this,
+    slot_handle h
+)
+//=============================================================================
+{
+    struct slotmap_t *m = this->_slotmap;
+    size_t n = slot_index(h);
+
+    return n < m->_vector._vector->_size && m->_gen[n] == slot_generation(h) && _bit_check_v(&m->_vector, n);
+}
+
+/* Erase everything, all handles handed out so far become stale. */
+//=============================================================================
+static void
+_clear_sm(
+    slotmap *this
+)
+//=============================================================================
+{
+    struct slotmap_t *m = this->_slotmap;
+    size_t n;
+
+    for (n = _bit_next_v(&m->_vector, 0); n < m->_vector._vector->_size; n = _bit_next_v(&m->_vector, n + 1)) {
+        if (!++m->_gen[n])
+            m->_gen[n] = 1;
+    }
+    vop.clear(&m->_vector);
+}
+
+/* EOF */
@@ -0,0 +1,82 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_slotmap.h
+*
+* DESCRIPTION:     Slot map with generation checked handles
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_SLOTMAP_H__
+#define __CSTL_SLOTMAP_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+#define SLOT_HANDLE_NULL        ((slot_handle)0)
+#define slot_index(h)           ((size_t)((h) & 0xffffffff))
+#define slot_generation(h)      ((uint32_t)((h) >> 32))
+
+//===========================
+// Typedefs
+//===========================
+/* generation << 32 | slot index, generations start at 1 so 0 never names a live element */
+typedef uint64_t slot_handle;
+
+/*
+ * Elements live in a vector, insert reuses erased slots through vop.insert and every slot
+ * carries a generation that is bumped on erase, so a handle to an erased element never
+ * matches again even after its slot has been reused. Automatic compaction must stay off
+ * on _vector, it would move elements away from their handles.
+ */
+typedef struct {
+    struct slotmap_t {
+        vector _vector;
+        size_t _gen_size;
+        uint32_t *_gen;
+    } *_slotmap;
+} slotmap;
+
+typedef struct {
+    bool (*empty)(slotmap *this);
+    size_t (*size)(slotmap *this);
+    slot_handle (*insert)(slotmap *this, void *ele);
+    bool (*erase)(slotmap *this, slot_handle h);
+    void *(*get)(slotmap *this, slot_handle h);
+    bool (*valid)(slotmap *this, slot_handle h);
+    void (*clear)(slotmap *this);
+} slotmap_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern slotmap_operation smop;
+
+/* Functions */
+void slotmap_op_init(void);
+struct slotmap_t *slotmap_constructor(slotmap *m, uint32_t tlen);
+void slotmap_destructor(slotmap *m);
+
+#endif
+/* EOF */
@@ -0,0 +1,368 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_snapshot.c
+*
+* DESCRIPTION:     Binary snapshots of vectors and queues
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "cstl_snapshot.h"
+//===========================
+// Defines
+//===========================
+#ifndef IOV_MAX
+#define IOV_MAX                 1024
+#endif
+#define bitmap_bytes(n)         ((((n) >> SHIFT) + ((n) & MASK ? 1 : 0)) * sizeof(uint32_t))
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+static bool _writev_all(int fd, struct iovec *iov, int cnt);
+static bool _readv_all(int fd, struct iovec *iov, int cnt);
+static bool _read_header(int fd, cstl_snapshot_t *hdr, uint8_t kind);
+
+//===========================
+// Globals
+//===========================
+
+/*
+ * Everything goes out straight from the container's storage. With CSTL_SNAPSHOT_STRIP the
+ * live runs between tombstones become the iovecs, nothing is copied either way.
+ */
+//=============================================================================
+inline bool
+vector_save(
+    vector *v,
+    int fd,
+    int flags
+)
+//=============================================================================
+{
+    struct vector_t *vec = v->_vector;
+    cstl_snapshot_t hdr = { CSTL_SNAPSHOT_MAGIC, CSTL_SNAPSHOT_VERSION, CSTL_SNAPSHOT_VECTOR, flags & CSTL_SNAPSHOT_STRIP, vec->_type_len, 0, vec->_size, vec->_used };
+    struct iovec iov[IOV_MAX];
+    size_t n, end;
+    int cnt = 0;
+
+    iov[cnt].iov_base = &hdr;
+    iov[cnt++].iov_len = sizeof(hdr);
+
+    if (!(hdr._flags & CSTL_SNAPSHOT_STRIP) || vec->_used == vec->_size) {
+        hdr._flags &= ~CSTL_SNAPSHOT_STRIP;
+        iov[cnt].iov_base = vec->_bitmap->_bitmap;
+        iov[cnt++].iov_len = bitmap_bytes(vec->_size);
+        iov[cnt].iov_base = vec->_vector;
+        iov[cnt++].iov_len = size2len2(v, vector);
+        return _writev_all(fd, iov, cnt);
+    }
+
+    hdr._count = vec->_used;
+    for (n = _bit_next_v(v, 0); n < vec->_size; n = _bit_next_v(v, end)) {
+        end = _bit_next_free_v(v, n);
+        iov[cnt].iov_base = &vec->_vector[n];
+        iov[cnt++].iov_len = size2len(v, end - n, vector);
+        if (cnt == IOV_MAX) {
+            if (!_writev_all(fd, iov, cnt))
+                return false;
+            cnt = 0;
+        }
+    }
+
+    return _writev_all(fd, iov, cnt);
+}
+
+/* The ring is written from front to rear, as one or two pieces. */
+//=============================================================================
+inline bool
+queue_save(
+    queue *q,
+    int fd
+)
+//=============================================================================
+{
+    struct queue_t *que = q->_queue;
+    cstl_snapshot_t hdr = { CSTL_SNAPSHOT_MAGIC, CSTL_SNAPSHOT_VERSION, CSTL_SNAPSHOT_QUEUE, 0, que->_type_len, 0, que->_size, que->_size };
+    size_t first = que->_size;
+    struct iovec iov[3];
+    int cnt = 0;
+
+    if (que->_front + first > que->_capacity)
+        first = que->_capacity - que->_front;
+
+    iov[cnt].iov_base = &hdr;
+    iov[cnt++].iov_len = sizeof(hdr);
+    if (first) {
+        iov[cnt].iov_base = &que->_queue[que->_front];
+        iov[cnt++].iov_len = size2len(q, first, queue);
+    }
+    if (first < que->_size) {
+        iov[cnt].iov_base = que->_queue;
+        iov[cnt++].iov_len = size2len(q, que->_size - first, queue);
+    }
+
+    return _writev_all(fd, iov, cnt);
+}
+
+/* Vector snapshots only. The live count is taken from the bitmap, not trusted from the header. */
+//=============================================================================
+inline bool
+vector_load(
+    vector *v,
+    int fd
+)
+//=============================================================================
+{
+    cstl_snapshot_t hdr;
+    struct iovec iov[2];
+    struct vector_t *vec;
+    size_t i, words, used = 0;
+
+    if (!_read_header(fd, &hdr, CSTL_SNAPSHOT_VECTOR) || hdr._type_len != v->_vector->_type_len)
+        return false;
+
+    vop.clear(v);
+    if (!vop.reserve(v, hdr._count))
+        return false;
+
+    vec = v->_vector;
+    words = bitmap_bytes(hdr._count) / sizeof(uint32_t);
+    iov[0].iov_base = vec->_bitmap->_bitmap;
+    iov[0].iov_len = hdr._flags & CSTL_SNAPSHOT_STRIP ? 0 : words * sizeof(uint32_t);
+    iov[1].iov_base = vec->_vector;
+    iov[1].iov_len = size2len(v, hdr._count, vector);
+    if (!_readv_all(fd, iov, 2)) {
+        memset(vec->_bitmap->_bitmap, 0, vec->_bitmap->_size);
+        return false;
+    }
+
+    vec->_size = hdr._count;
+    if (hdr._flags & CSTL_SNAPSHOT_STRIP) {
+        _bit_set_range_v(v, 0, hdr._count);
+        vec->_used = hdr._count;
+        stats_sync_v(v);
+        return true;
+    }
+
+    /* bits past _count must read as free */
+    if (hdr._count & MASK)
+        vec->_bitmap->_bitmap[words - 1] &= (1U << (hdr._count & MASK)) - 1;
+    for (i = 0; i < words; i++)
+        used += __builtin_popcount(vec->_bitmap->_bitmap[i]);
+    vec->_used = used;
+    stats_sync_v(v);
+    return true;
+}
+
+//=============================================================================
+inline bool
+queue_load(
+    queue *q,
+    int fd
+)
+//=============================================================================
+{
+    cstl_snapshot_t hdr;
+    struct iovec iov;
+    struct queue_t *que;
+
+    if (!_read_header(fd, &hdr, CSTL_SNAPSHOT_QUEUE) || hdr._type_len != q->_queue->_type_len)
+        return false;
+
+    q->_queue->_size = 0;
+    q->_queue->_front = 0;
+    q->_queue->_rear = 0;
+    stats_sync_q(q);
+    if (!qop.reserve(q, hdr._count))
+        return false;
+
+    que = q->_queue;
+    iov.iov_base = que->_queue;
+    iov.iov_len = size2len(q, hdr._count, queue);
+    if (!_readv_all(fd, &iov, 1))
+        return false;
+
+    que->_size = hdr._count;
+    que->_rear = hdr._count;
+    stats_sync_q(q);
+    return true;
+}
+
+/*
+ * Reads bitmap and elements one chunk at a time with pread, so fd must be seekable. Memory
+ * use is one chunk whatever the snapshot size.
+ */
+//=============================================================================
+inline bool
+snapshot_stream(
+    int fd,
+    snapshot_visit fn,
+    void *ctx
+)
+//=============================================================================
+{
+    cstl_snapshot_t hdr;
+    off_t bitmap_off, data_off;
+    uint32_t *bits = NULL;
+    uint8_t *buf;
+    size_t done, n, i, live, len;
+    bool rc = false, dense;
+
+    bitmap_off = lseek(fd, 0, SEEK_CUR);
+    if (bitmap_off < 0 || !_read_header(fd, &hdr, 0))
+        return false;
+
+    bitmap_off += sizeof(hdr);
+    dense = hdr._kind != CSTL_SNAPSHOT_VECTOR || (hdr._flags & CSTL_SNAPSHOT_STRIP);
+    data_off = bitmap_off + (dense ? 0 : bitmap_bytes(hdr._count));
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    buf = (uint8_t *)malloc((size_t)CSTL_SNAPSHOT_CHUNK * hdr._type_len);
+    if (!dense)
+        bits = (uint32_t *)malloc(bitmap_bytes(CSTL_SNAPSHOT_CHUNK));
+    if (!buf || (!dense && !bits))
+        goto out;
+
+    for (done = 0; done < hdr._count; done += n) {
+        n = hdr._count - done < CSTL_SNAPSHOT_CHUNK ? hdr._count - done : CSTL_SNAPSHOT_CHUNK;
+        len = n * hdr._type_len;
+        if (pread(fd, buf, len, data_off + done * hdr._type_len) != (ssize_t)len)
+            goto out;
+
+        live = n;
+        if (!dense) {
+            if (pread(fd, bits, bitmap_bytes(n), bitmap_off + done / 8) != (ssize_t)bitmap_bytes(n))
+                goto out;
+            /* squeeze the live elements of the chunk to its front */
+            for (i = 0, live = 0; i < n; i++) {
+                if (!(bits[i >> SHIFT] & (1U << (i & MASK))))
+                    continue;
+                if (live != i)
+                    memcpy(buf + live * hdr._type_len, buf + i * hdr._type_len, hdr._type_len);
+                live++;
+            }
+        }
+
+        if (live && !fn(ctx, buf, live))
+            break;
+    }
+    rc = true;
+
+out:
+    free(bits);
+    free(buf);
+    return rc;
+}
+
+/* writev until everything is out, resuming after short writes and EINTR */
+//=============================================================================
+static bool
+_writev_all(
+    int fd,
+    struct iovec *iov,
+    int cnt
+)
+//=============================================================================
+{
+    ssize_t r;
+
+    while (cnt) {
+        r = writev(fd, iov, cnt);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        for (; cnt && (size_t)r >= iov->iov_len; cnt--, iov++)
+            r -= iov->iov_len;
+        if (cnt) {
+            iov->iov_base = (uint8_t *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+
+    return true;
+}
+
+//=============================================================================
+static bool
+_readv_all(
+    int fd,
+    struct iovec *iov,
+    int cnt
+)
+//=============================================================================
+{
+    ssize_t r;
+
+    while (cnt) {
+        if (!iov->iov_len) {
+            iov++;
+            cnt--;
+            continue;
+        }
+        r = readv(fd, iov, cnt);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (!r)
+            return false;
+        for (; cnt && (size_t)r >= iov->iov_len; cnt--, iov++)
+            r -= iov->iov_len;
+        if (cnt) {
+            iov->iov_base = (uint8_t *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+
+    return true;
+}
+
+/* kind 0 accepts any kind */
+//=============================================================================
+static bool
+_read_header(
+    int fd,
+    cstl_snapshot_t *hdr,
+    uint8_t kind
+)
+//=============================================================================
+{
+    struct iovec iov = { hdr, sizeof(*hdr) };
+
+    if (!_readv_all(fd, &iov, 1))
+        return false;
+
+    return hdr->_magic == CSTL_SNAPSHOT_MAGIC && hdr->_version == CSTL_SNAPSHOT_VERSION &&
+        (!kind || hdr->_kind == kind) && hdr->_type_len && hdr->_used <= hdr->_count;
+}
+
+/* EOF */
@@ -0,0 +1,91 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_snapshot.h
+*
+* DESCRIPTION:     Binary snapshots of vectors and queues
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_SNAPSHOT_H__
+#define __CSTL_SNAPSHOT_H__
+
+//===========================
+// Includes
+//===========================
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+#define CSTL_SNAPSHOT_MAGIC     0x50534e43      /* "CNSP" */
+#define CSTL_SNAPSHOT_VERSION   1
+
+/* cstl_snapshot_t._kind */
+#define CSTL_SNAPSHOT_VECTOR    1
+#define CSTL_SNAPSHOT_QUEUE     2
+
+/* cstl_snapshot_t._flags, also taken by vector_save */
+#define CSTL_SNAPSHOT_STRIP     0x1     /* tombstones dropped, live elements only and no bitmap */
+
+/* elements per read of snapshot_stream, a multiple of 32 */
+#define CSTL_SNAPSHOT_CHUNK     65536
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * A snapshot is this header, the occupancy bitmap of _count slots as 32 bit words (vectors
+ * saved without CSTL_SNAPSHOT_STRIP only), then _count elements of _type_len bytes. Host
+ * byte order, elements are written as they are and must not be pointers.
+ */
+typedef struct {
+    uint32_t _magic;
+    uint16_t _version;
+    uint8_t _kind;
+    uint8_t _flags;
+    uint32_t _type_len;
+    uint32_t _reserved;
+    uint64_t _count;
+    uint64_t _used;
+} cstl_snapshot_t;
+
+/* n live elements of the snapshot's _type_len, return false to stop */
+typedef bool (*snapshot_visit)(void *ctx, const void *eles, size_t n);
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+/* Both write at the current offset of fd and return false on any I/O error. */
+bool vector_save(vector *v, int fd, int flags);
+bool queue_save(queue *q, int fd);
+/*
+ * Replace the content of a constructed container with the snapshot at the current offset
+ * of fd, storage is sized once and read into directly. Fails if the element size differs.
+ */
+bool vector_load(vector *v, int fd);
+bool queue_load(queue *q, int fd);
+/* Hand the live elements of a snapshot to fn chunk by chunk, for snapshots that don't fit in memory. */
+bool snapshot_stream(int fd, snapshot_visit fn, void *ctx);
+
+#endif
+/* EOF */
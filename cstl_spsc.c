@@ -0,0 +1,206 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_spsc.c
+*
+* DESCRIPTION:     Lock-free single producer / single consumer ring queue
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+//===========================
+// Includes
+//===========================
+#include "cstl_spsc.h"
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+spsc_queue_operation sqop;
+
+/* Functions */
+static bool _empty_sq(spsc_queue *this);
+static size_t _size_sq(spsc_queue *this);
+static size_t _capacity_sq(spsc_queue *this);
+static void *_front_sq(spsc_queue *this);
+static bool _push_sq(spsc_queue *this, void *ele);
+static void _pop_sq(spsc_queue *this);
+
+//=============================================================================
+inline void
+spsc_queue_op_init(
+    void
+)
+//=============================================================================
+{
+    sqop.empty = _empty_sq;
+    sqop.size = _size_sq;
+    sqop.capacity = _capacity_sq;
+    sqop.front = _front_sq;
+    sqop.push = _push_sq;
+    sqop.pop = _pop_sq;
+}
+
+/* capacity is rounded up to a power of two, the ring never grows after construction. */
+//=============================================================================
+inline struct spsc_queue_t *
+spsc_queue_constructor(
+    spsc_queue *q,
+    uint32_t tlen,
+    size_t capacity
+)
+//=============================================================================
+{
+    size_t cap = 1;
+    size_t len;
+
+    while (cap < capacity)
+        cap <<= 1;
+
+    len = sizeof(struct spsc_queue_t) + cap * sizeof(void *);
+    len = (len + CSTL_CACHELINE - 1) & ~((size_t)CSTL_CACHELINE - 1);
+    q->_queue = (struct spsc_queue_t *)aligned_alloc(CSTL_CACHELINE, len);
+    if (q->_queue) {
+        memset(q->_queue, 0, sizeof(struct spsc_queue_t));
+        atomic_init(&q->_queue->_front, 0);
+        atomic_init(&q->_queue->_rear, 0);
+        q->_queue->_capacity = cap;
+        q->_queue->_type_len = tlen;
+    }
+
+    debug(LOG_DEBUG, "spsc queue constructor: q: %p, _q: %p, capa: %ld", q, q->_queue, cap);
+    return q->_queue;
+}
+
+//=============================================================================
+inline void
+spsc_queue_destructor(
+    spsc_queue *q
+)
+//=============================================================================
+{
+    if (q->_queue)
+        free(q->_queue);
+    q->_queue = NULL;
+}
+
+/* empty and size may be called from either side, the answer may be stale by the time it returns. */
+//=============================================================================
+static bool
+_empty_sq(
+    spsc_queue *this
+)
+//=============================================================================
+{
+    return _size_sq(this) ? false : true;
+}
+
+//=============================================================================
+static size_t
+_size_sq(
+    spsc_queue *this
+)
+//=============================================================================
+{
+    size_t front = atomic_load_explicit(&this->_queue->_front, memory_order_acquire);
+    size_t rear = atomic_load_explicit(&this->_queue->_rear, memory_order_acquire);
+
+    return rear - front;
+}
+
+//=============================================================================
+static size_t
+_capacity_sq(
+    spsc_queue *this
+)
+//=============================================================================
+{
+    return this->_queue->_capacity;
+}
+
+/* consumer side, returns NULL when empty */
+//=============================================================================
+static void *
+_front_sq(
+    spsc_queue *this
+)
+//=============================================================================
+{
+    struct spsc_queue_t *q = this->_queue;
+    size_t front = atomic_load_explicit(&q->_front, memory_order_relaxed);
+
+    if (front == q->_rear_cache) {
+        q->_rear_cache = atomic_load_explicit(&q->_rear, memory_order_acquire);
+        if (front == q->_rear_cache)
+            return NULL;
+    }
+
+    return q->_queue[front & (q->_capacity - 1)];
+}
+
+/* producer side, returns false when full */
+//=============================================================================
+static bool
+_push_sq(
+    spsc_queue *this,
+    void *ele
+)
+//=============================================================================
+{
+    struct spsc_queue_t *q = this->_queue;
+    size_t rear = atomic_load_explicit(&q->_rear, memory_order_relaxed);
+
+    if (rear - q->_front_cache == q->_capacity) {
+        q->_front_cache = atomic_load_explicit(&q->_front, memory_order_acquire);
+        if (rear - q->_front_cache == q->_capacity)
+            return false;
+    }
+
+    q->_queue[rear & (q->_capacity - 1)] = ele;
+    atomic_store_explicit(&q->_rear, rear + 1, memory_order_release);
+    return true;
+}
+
+/* consumer side */
+//=============================================================================
+static void
+_pop_sq(
+    spsc_queue *this
+)
+//=============================================================================
+{
+    struct spsc_queue_t *q = this->_queue;
+    size_t front = atomic_load_explicit(&q->_front, memory_order_relaxed);
+
+    if (front == q->_rear_cache) {
+        q->_rear_cache = atomic_load_explicit(&q->_rear, memory_order_acquire);
+        if (front == q->_rear_cache)
+            return;
+    }
+
+    atomic_store_explicit(&q->_front, front + 1, memory_order_release);
+}
+
+/* EOF */
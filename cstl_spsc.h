@@ -0,0 +1,83 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_spsc.h
+*
+* DESCRIPTION:     Lock-free single producer / single consumer ring queue
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+#ifndef __CSTL_SPSC_H__
+#define __CSTL_SPSC_H__
+
+//===========================
+// Includes
+//===========================
+#include <stdatomic.h>
+#include "cstl.h"
+
+//===========================
+// Defines
+//===========================
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * Fixed capacity ring shared by exactly one producer thread (push) and one consumer
+ * thread (front, pop). _front and _rear run freely and are masked into the ring, each
+ * side keeps a cached copy of the other side's index on its own cache line so it only
+ * touches the shared line when the cache says full or empty.
+ */
+typedef struct {
+    struct spsc_queue_t {
+        /* consumer */
+        _Alignas(CSTL_CACHELINE) atomic_size_t _front;
+        size_t _rear_cache;
+        /* producer */
+        _Alignas(CSTL_CACHELINE) atomic_size_t _rear;
+        size_t _front_cache;
+        /* read only */
+        _Alignas(CSTL_CACHELINE) size_t _capacity;
+        uint32_t _type_len;
+        void *_queue[];
+    } *_queue;
+} spsc_queue;
+
+typedef struct {
+    bool (*empty)(spsc_queue *this);
+    size_t (*size)(spsc_queue *this);
+    size_t (*capacity)(spsc_queue *this);
+    void *(*front)(spsc_queue *this);
+    bool (*push)(spsc_queue *this, void *ele);
+    void (*pop)(spsc_queue *this);
+} spsc_queue_operation;
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+extern spsc_queue_operation sqop;
+
+/* Functions */
+void spsc_queue_op_init(void);
+struct spsc_queue_t *spsc_queue_constructor(spsc_queue *q, uint32_t tlen, size_t capacity);
+void spsc_queue_destructor(spsc_queue *q);
+
+#endif
+/* EOF */
@@ -0,0 +1,225 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_trace.c
+*
+* DESCRIPTION:     Compile time selected tracing into per-thread binary rings
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+//===========================
+// Includes
+//===========================
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "cstl.h"
+//===========================
+// Defines
+//===========================
+#ifndef LOG_TAG
+#define LOG_TAG    "[cstl]"
+#endif
+
+//===========================
+// Typedefs
+//===========================
+/*
+ * _seq is index + 1 once the slot is complete and 0 while it is being written, so the dump
+ * can skip slots the owner is rewriting under it (seqlock, single writer).
+ */
+struct trace_event_t {
+    atomic_ulong _seq;
+    uint64_t _ns;
+    const char *_fmt;
+    int _tid;
+    uint8_t _level;
+    uint8_t _nargs;
+    unsigned long _args[CSTL_TRACE_ARGS];
+};
+
+/*
+ * One ring per thread, written only by its owner. Rings are linked once and never freed,
+ * a ring whose thread exited is handed to the next thread that starts tracing.
+ */
+struct trace_ring_t {
+    struct trace_ring_t *_next;
+    atomic_bool _busy;
+    atomic_ulong _head;
+    struct trace_event_t _events[CSTL_TRACE_RING];
+};
+
+//===========================
+// Locals
+//===========================
+static _Atomic(struct trace_ring_t *) rings;
+static __thread struct trace_ring_t *ring;
+static __thread int ring_tid;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+static struct trace_ring_t *_claim_ring(void);
+static void _release_ring(void *r);
+static void _ring_key_init(void);
+
+//===========================
+// Globals
+//===========================
+
+//=============================================================================
+inline void
+cstl_trace_event(
+    int level,
+    const char *fmt,
+    int nargs,
+    ...
+)
+//=============================================================================
+{
+    struct trace_ring_t *r = ring ? ring : _claim_ring();
+    struct trace_event_t *e;
+    struct timespec ts;
+    unsigned long head;
+    va_list ap;
+    int i;
+
+    if (!r)
+        return;
+
+    head = atomic_load_explicit(&r->_head, memory_order_relaxed);
+    e = &r->_events[head & (CSTL_TRACE_RING - 1)];
+    atomic_store_explicit(&e->_seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    /* served by the vdso, no syscall */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    e->_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    e->_fmt = fmt;
+    e->_tid = ring_tid;
+    e->_level = level;
+    e->_nargs = nargs;
+    va_start(ap, nargs);
+    for (i = 0; i < nargs && i < CSTL_TRACE_ARGS; i++)
+        e->_args[i] = va_arg(ap, unsigned long);
+    va_end(ap);
+
+    atomic_store_explicit(&e->_seq, head + 1, memory_order_release);
+    atomic_store_explicit(&r->_head, head + 1, memory_order_release);
+}
+
+/*
+ * Safe to call while other threads keep tracing, events overwritten during the copy are
+ * skipped rather than printed torn.
+ */
+//=============================================================================
+inline void
+cstl_trace_dump(
+    int fd
+)
+//=============================================================================
+{
+    static const char *levels[] = { "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug" };
+    struct trace_ring_t *r;
+    struct trace_event_t e;
+    unsigned long head, i, seq;
+    char msg[256];
+
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->_next) {
+        head = atomic_load_explicit(&r->_head, memory_order_acquire);
+        for (i = head > CSTL_TRACE_RING ? head - CSTL_TRACE_RING : 0; i < head; i++) {
+            struct trace_event_t *src = &r->_events[i & (CSTL_TRACE_RING - 1)];
+
+            seq = atomic_load_explicit(&src->_seq, memory_order_acquire);
+            if (seq != i + 1)
+                continue;
+            e._ns = src->_ns;
+            e._fmt = src->_fmt;
+            e._tid = src->_tid;
+            e._level = src->_level;
+            memcpy(e._args, src->_args, sizeof(e._args));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&src->_seq, memory_order_relaxed) != seq)
+                continue;
+
+            snprintf(msg, sizeof(msg), e._fmt, e._args[0], e._args[1], e._args[2], e._args[3], e._args[4], e._args[5]);
+            dprintf(fd, "%lu.%09lu %d %s " LOG_TAG "%s\n", (unsigned long)(e._ns / 1000000000ULL),
+                    (unsigned long)(e._ns % 1000000000ULL), e._tid, levels[e._level & 7], msg);
+        }
+    }
+}
+
+/* First event of this thread, reuse the ring of an exited thread or link a new one. */
+//=============================================================================
+static struct trace_ring_t *
+_claim_ring(
+    void
+)
+//=============================================================================
+{
+    struct trace_ring_t *r;
+    bool busy;
+
+    pthread_once(&ring_once, _ring_key_init);
+    ring_tid = (int)syscall(SYS_gettid);
+
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->_next) {
+        busy = false;
+        if (atomic_compare_exchange_strong(&r->_busy, &busy, true))
+            break;
+    }
+
+    if (!r) {
+        r = (struct trace_ring_t *)calloc(1, sizeof(struct trace_ring_t));
+        if (!r)
+            return NULL;
+        atomic_init(&r->_busy, true);
+        r->_next = atomic_load_explicit(&rings, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&rings, &r->_next, r, memory_order_release, memory_order_relaxed))
+            ;
+    }
+
+    ring = r;
+    pthread_setspecific(ring_key, r);
+    return r;
+}
+
+//=============================================================================
+static void
+_release_ring(
+    void *r
+)
+//=============================================================================
+{
+    atomic_store_explicit(&((struct trace_ring_t *)r)->_busy, false, memory_order_release);
+}
+
+//=============================================================================
+static void
+_ring_key_init(
+    void
+)
+//=============================================================================
+{
+    pthread_key_create(&ring_key, _release_ring);
+}
+
+/* EOF */
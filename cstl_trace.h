@@ -0,0 +1,99 @@
+/****************************************************************************
+*
+* FILENAME:        cstl_trace.h
+*
+* DESCRIPTION:     Compile time selected tracing into per-thread binary rings
+*
+* Copyright (c) 2017 by Grandstream Networks, Inc.
+* All rights reserved.
+*
+* This material is proprietary to Grandstream Networks, Inc. and,
+* in addition to the above mentioned Copyright, may be
+* subject to protection under other intellectual property
+* regimes, including patents, trade secrets, designs and/or
+* trademarks.
+*
+* Any use of this material for any purpose, except with an
+* express license from Grandstream Networks, Inc. is strictly
+* prohibited.
+*
+***************************************************************************/
+
+
+#ifndef __CSTL_TRACE_H__
+#define __CSTL_TRACE_H__
+
+//===========================
+// Includes
+//===========================
+#include <stdint.h>
+#include <syslog.h>
+
+//===========================
+// Defines
+//===========================
+/*
+ * Highest syslog level (LOG_ERR .. LOG_DEBUG) recorded, -1 compiles every trace point out.
+ * Build with e.g. GSFLAGS=-DCSTL_TRACE=LOG_INFO to keep errors and info events only.
+ */
+#ifndef CSTL_TRACE
+#if CSTL_DEBUG
+#define CSTL_TRACE          LOG_DEBUG
+#else
+#define CSTL_TRACE          -1
+#endif
+#endif
+
+/* events kept per thread, a power of two, older ones are overwritten */
+#define CSTL_TRACE_RING     1024
+/* arguments kept per event, each is widened to unsigned long */
+#define CSTL_TRACE_ARGS     6
+
+/*
+ * debug(level, fmt, ...) records fmt and its arguments without formatting them, the text is
+ * built by cstl_trace_dump. fmt must be a string literal and the arguments integers or
+ * pointers printed with long sized conversions (%ld, %lu, %lx, %p).
+ */
+#if CSTL_TRACE < 0
+#define debug(LOG_LEVEL, fmt, ...)  do { } while (0)
+#else
+#define debug(LOG_LEVEL, fmt, ...) \
+    do { \
+        if ((LOG_LEVEL) <= CSTL_TRACE) \
+            cstl_trace_event(LOG_LEVEL, fmt, _TRACE_NARGS(__VA_ARGS__) _TRACE_MAP(__VA_ARGS__)); \
+    } while (0)
+#endif
+
+#define _TRACE_CAT(a, b)            _TRACE_CAT_(a, b)
+#define _TRACE_CAT_(a, b)           a##b
+#define _TRACE_NARGS(...)           _TRACE_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define _TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define _TRACE_MAP(...)             _TRACE_CAT(_TRACE_MAP, _TRACE_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define _TRACE_MAP0()
+#define _TRACE_MAP1(a)              , (unsigned long)(a)
+#define _TRACE_MAP2(a, ...)         , (unsigned long)(a) _TRACE_MAP1(__VA_ARGS__)
+#define _TRACE_MAP3(a, ...)         , (unsigned long)(a) _TRACE_MAP2(__VA_ARGS__)
+#define _TRACE_MAP4(a, ...)         , (unsigned long)(a) _TRACE_MAP3(__VA_ARGS__)
+#define _TRACE_MAP5(a, ...)         , (unsigned long)(a) _TRACE_MAP4(__VA_ARGS__)
+#define _TRACE_MAP6(a, ...)         , (unsigned long)(a) _TRACE_MAP5(__VA_ARGS__)
+
+//===========================
+// Typedefs
+//===========================
+
+//===========================
+// Locals
+//===========================
+
+//===========================
+// Globals
+//===========================
+
+/* Functions */
+/* nargs unsigned long arguments follow fmt */
+void cstl_trace_event(int level, const char *fmt, int nargs, ...);
+/* Format the events of every thread that traced so far, oldest first per thread, into fd. */
+void cstl_trace_dump(int fd);
+
+#endif
+/* EOF */